@@ -159,6 +159,9 @@ usage(void)
 #ifdef DCT_FLOAT_SUPPORTED
   fprintf(stderr, "  -dct float     Use floating-point DCT method [legacy feature]%s\n",
           (JDCT_DEFAULT == JDCT_FLOAT ? " (default)" : ""));
+#endif
+#if defined(DCT_ISLOW_SUPPORTED) && defined(DCT_IFAST_SUPPORTED)
+  fprintf(stderr, "  -dct auto      Choose int or fast DCT method based on quantization tables\n");
 #endif
   fprintf(stderr, "  -dither fs     Use F-S dithering (default)\n");
   fprintf(stderr, "  -dither none   Don't use dithering in quantization\n");
@@ -255,6 +258,8 @@ parse_switches(j_decompress_ptr cinfo, int argc, char **argv,
         cinfo->dct_method = JDCT_IFAST;
       } else if (keymatch(argv[argn], "float", 2)) {
         cinfo->dct_method = JDCT_FLOAT;
+      } else if (keymatch(argv[argn], "auto", 1)) {
+        cinfo->dct_method = JDCT_AUTO;
       } else
         usage();
 
@@ -448,12 +448,51 @@ public final class TJ {
    * <a href="https://libjpeg-turbo.org/pmwiki/uploads/About/TwoIssueswiththeJPEGStandard.pdf" target="_blank">this report</a>.
    */
   public static final int FLAG_LIMITSCANS    = 32768;
+  /**
+   * When compressing, remember the quantized DCT coefficients of recently
+   * encoded 8x8 blocks, and reuse them for identical blocks in the same image
+   * or in subsequent images compressed with the same {@link TJCompressor}
+   * instance.  This speeds up the compression of screen content and other
+   * images that contain many repeated blocks.  It does not change the
+   * compressed output.  The cache requires about 200 KB of memory per
+   * quantization table, and that memory is retained until the
+   * {@link TJCompressor} instance is closed.
+   */
+  public static final int FLAG_BLOCKCACHE    = 65536;
+  /**
+   * Compress successive images (such as desktop or video frames)
+   * incrementally.  When this flag is passed to
+   * {@link TJCompressor#compress(byte[], int) TJCompressor.compress()}, the
+   * JPEG image is generated with one restart interval per MCU row, and the
+   * {@link TJCompressor} instance retains a copy of the source image along
+   * with the entropy-coded data for each restart interval.  If the next image
+   * compressed with this flag has the same dimensions, pixel format,
+   * subsampling, and quality, then only the MCU rows that have changed are
+   * re-encoded, and the entropy-coded data for the other MCU rows is reused.
+   * The resulting JPEG image is identical to the one that would have been
+   * generated had the image been compressed in full.  This flag is ignored
+   * when generating progressive JPEG images and when compressing from a YUV
+   * image.
+   */
+  public static final int FLAG_INCREMENTAL   = 131072;
+  /**
+   * When decompressing, choose the IDCT algorithm separately for each
+   * component based on its quantization table.  The fast algorithm is used for
+   * components whose quantization table entries average 16 or more (with the
+   * standard tables, this corresponds to a JPEG quality of about 86 or below
+   * for luminance and about 90 or below for chrominance), since the additional
+   * error that it introduces is small relative to the quantization error in
+   * that case.  The accurate algorithm is used for all other components.  This
+   * flag is ignored when compressing and if {@link #FLAG_FASTDCT} is also
+   * specified.
+   */
+  public static final int FLAG_AUTODCT       = 262144;
 
 
   /**
    * The number of error codes
    */
-  public static final int NUMERR = 2;
+  public static final int NUMERR = 3;
   /**
    * The error was non-fatal and recoverable, but the image may still be
    * corrupt.
@@ -468,6 +507,15 @@ public final class TJ {
    * The error was fatal and non-recoverable.
    */
   public static final int ERR_FATAL = 1;
+  /**
+   * The operation was cancelled, or it exceeded its time limit.
+   * <p>
+   * NOTE: the TurboJPEG Java API does not currently provide a way to cancel an
+   * operation or to set a time limit, so Java applications will not encounter
+   * this error code.  It is defined so that {@link TJException#getErrorCode()}
+   * covers all of the error codes in the TurboJPEG C API.
+   */
+  public static final int ERR_ABORTED = 2;
 
 
   /**
@@ -22,6 +22,12 @@
 #include "jdct.h"               /* Private declarations for DCT subsystem */
 #include "jsimddct.h"
 
+#ifndef NO_GETENV
+#ifndef HAVE_STDLIB_H           /* <stdlib.h> should declare getenv() */
+extern char *getenv(const char *name);
+#endif
+#endif
+
 
 /* Private subobject for this module */
 
@@ -43,6 +49,38 @@ typedef void (*float_quantize_method_ptr) (JCOEFPTR coef_block,
 
 METHODDEF(void) quantize(JCOEFPTR, DCTELEM *, DCTELEM *);
 
+/*
+ * Screen content tends to contain many identical blocks (text glyphs, user
+ * interface elements, etc.)  If requested by the application, we remember the
+ * quantized coefficients of recently encoded blocks in a direct-mapped hash
+ * table and reuse them rather than repeating the DCT and quantization.  The
+ * table has one segment per quantization table slot, and a segment is cleared
+ * whenever the quantization table or DCT method associated with it changes.
+ * The cache is allocated from the permanent pool, so it can be kept across
+ * images (see jinit_fdct_block_cache() below.)
+ */
+
+#define BLOCK_CACHE_BITS  10
+#define BLOCK_CACHE_SIZE  (1 << BLOCK_CACHE_BITS) /* entries per segment */
+
+typedef struct {
+  JBLOCK coefs;                 /* quantized coefficients */
+  JSAMPLE samples[DCTSIZE2];    /* source samples, for confirming a hit */
+  unsigned int hash;            /* hash of samples[] */
+  boolean valid;                /* TRUE if this entry has been filled */
+} block_cache_entry;
+
+typedef struct {
+  /* Parameters with which the entries were computed */
+  J_DCT_METHOD dct_method;
+  UINT16 quantval[DCTSIZE2];
+  block_cache_entry *entries;   /* BLOCK_CACHE_SIZE entries */
+} block_cache_segment;
+
+struct block_cache {
+  block_cache_segment *segments[NUM_QUANT_TBLS];
+};
+
 typedef struct {
   struct jpeg_forward_dct pub;  /* public fields */
 
@@ -60,6 +98,12 @@ typedef struct {
   /* work area for FDCT subroutine */
   DCTELEM *workspace;
 
+  /* Block reuse cache, or NULL if not in use */
+  struct block_cache *block_cache;
+
+  /* TRUE to skip the DCT for blocks in which all samples are the same */
+  boolean bypass_flat_blocks;
+
 #ifdef DCT_FLOAT_SUPPORTED
   /* Same as above for the floating-point case. */
   float_DCT_method_ptr float_dct;
@@ -478,6 +522,156 @@ quantize(JCOEFPTR coef_block, DCTELEM *divisors, DCTELEM *workspace)
 }
 
 
+/*
+ * Quantize/descale a single coefficient.  This is used for the DC term of
+ * flat blocks, so it must produce exactly the same result as quantize() (and
+ * jsimd_quantize(), which is bit-exact with it.)
+ */
+
+LOCAL(JCOEF)
+quantize_coef(DCTELEM temp, DCTELEM *divisors)
+{
+#if BITS_IN_JSAMPLE == 8
+
+  UDCTELEM recip = divisors[DCTSIZE2 * 0];
+  UDCTELEM corr = divisors[DCTSIZE2 * 1];
+  int shift = divisors[DCTSIZE2 * 3];
+  UDCTELEM2 product;
+
+  if (temp < 0) {
+    temp = -temp;
+    product = (UDCTELEM2)(temp + corr) * recip;
+    product >>= shift + sizeof(DCTELEM) * 8;
+    temp = -(DCTELEM)product;
+  } else {
+    product = (UDCTELEM2)(temp + corr) * recip;
+    product >>= shift + sizeof(DCTELEM) * 8;
+    temp = (DCTELEM)product;
+  }
+
+#else
+
+  DCTELEM qval = divisors[0];
+
+  if (temp < 0) {
+    temp = -temp;
+    temp += qval >> 1;
+    DIVIDE_BY(temp, qval);
+    temp = -temp;
+  } else {
+    temp += qval >> 1;
+    DIVIDE_BY(temp, qval);
+  }
+
+#endif
+
+  return (JCOEF)temp;
+}
+
+
+/*
+ * Determine whether all of the samples in a block have the same value.
+ * Screen content and documents are dominated by such blocks.  A differing
+ * sample usually shows up in the first row, so the early exit keeps the cost
+ * negligible for photographic content.  The inner loop is simple enough for
+ * the compiler to vectorize.
+ */
+
+LOCAL(boolean)
+is_flat_block(JSAMPARRAY sample_data, JDIMENSION start_col)
+{
+  register JSAMPROW elemptr;
+  register int elemr, elemc;
+  register int diff = 0;
+  JSAMPLE value = sample_data[0][start_col];
+
+  for (elemr = 0; elemr < DCTSIZE; elemr++) {
+    elemptr = sample_data[elemr] + start_col;
+    for (elemc = 0; elemc < DCTSIZE; elemc++)
+      diff |= elemptr[elemc] ^ value;
+    if (diff)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Look up a block in the block reuse cache.  On a hit, the cached
+ * coefficients are copied to coef_block and TRUE is returned.  On a miss, the
+ * entry that should receive the block once it has been quantized is returned
+ * in *entryptr.
+ */
+
+LOCAL(boolean)
+lookup_cached_block(block_cache_segment *seg, JSAMPARRAY sample_data,
+                    JDIMENSION start_col, JCOEFPTR coef_block,
+                    block_cache_entry **entryptr)
+{
+  register JSAMPROW elemptr;
+  register JSAMPLE *cacheptr;
+  register int elemr, elemc;
+  register unsigned int hash = 0, lo, hi;
+  block_cache_entry *entry;
+
+  /* Fold each row into the hash as two 32-bit words.  (With 12-bit samples,
+   * this discards the upper bits, which makes the hash weaker but doesn't
+   * affect correctness.)
+   */
+  for (elemr = 0; elemr < DCTSIZE; elemr++) {
+    elemptr = sample_data[elemr] + start_col;
+    lo = (unsigned int)elemptr[0] | ((unsigned int)elemptr[1] << 8) |
+         ((unsigned int)elemptr[2] << 16) | ((unsigned int)elemptr[3] << 24);
+    hi = (unsigned int)elemptr[4] | ((unsigned int)elemptr[5] << 8) |
+         ((unsigned int)elemptr[6] << 16) | ((unsigned int)elemptr[7] << 24);
+    hash = (hash ^ lo) * 0x9E3779B1U;
+    hash = (hash ^ hi) * 0x9E3779B1U;
+  }
+  hash ^= hash >> 16;
+
+  entry = &seg->entries[hash & (BLOCK_CACHE_SIZE - 1)];
+  *entryptr = entry;
+  if (entry->valid && entry->hash == hash) {
+    register int diff = 0;
+
+    cacheptr = entry->samples;
+    for (elemr = 0; elemr < DCTSIZE; elemr++) {
+      elemptr = sample_data[elemr] + start_col;
+      for (elemc = 0; elemc < DCTSIZE; elemc++)
+        diff |= *cacheptr++ ^ elemptr[elemc];
+    }
+    if (!diff) {
+      MEMCOPY(coef_block, entry->coefs, sizeof(JBLOCK));
+      return TRUE;
+    }
+  }
+
+  /* Miss: the caller will overwrite this entry. */
+  entry->hash = hash;
+  entry->valid = FALSE;
+  return FALSE;
+}
+
+
+/*
+ * Store a newly quantized block in the entry returned by
+ * lookup_cached_block().  The entry's hash has already been computed.
+ */
+
+LOCAL(void)
+store_cached_block(block_cache_entry *entry, JSAMPARRAY sample_data,
+                   JDIMENSION start_col, JCOEFPTR coef_block)
+{
+  int elemr;
+
+  for (elemr = 0; elemr < DCTSIZE; elemr++)
+    MEMCOPY(&entry->samples[elemr * DCTSIZE], sample_data[elemr] + start_col,
+            DCTSIZE * sizeof(JSAMPLE));
+  MEMCOPY(entry->coefs, coef_block, sizeof(JBLOCK));
+  entry->valid = TRUE;
+}
+
+
 /*
  * Perform forward DCT on one or more blocks of a component.
  *
@@ -497,16 +691,38 @@ forward_DCT(j_compress_ptr cinfo, jpeg_component_info *compptr,
   DCTELEM *divisors = fdct->divisors[compptr->quant_tbl_no];
   DCTELEM *workspace;
   JDIMENSION bi;
+  block_cache_segment *cache = NULL;
+  block_cache_entry *entry = NULL;
 
   /* Make sure the compiler doesn't look up these every pass */
   forward_DCT_method_ptr do_dct = fdct->dct;
   convsamp_method_ptr do_convsamp = fdct->convsamp;
   quantize_method_ptr do_quantize = fdct->quantize;
   workspace = fdct->workspace;
+  if (fdct->block_cache != NULL)
+    cache = fdct->block_cache->segments[compptr->quant_tbl_no];
 
   sample_data += start_row;     /* fold in the vertical offset once */
 
   for (bi = 0; bi < num_blocks; bi++, start_col += DCTSIZE) {
+    if (fdct->bypass_flat_blocks && is_flat_block(sample_data, start_col)) {
+      /* The DCT of a constant block has no AC energy, and both integer DCT
+       * algorithms produce a DC term of exactly DCTSIZE2 times the
+       * level-shifted sample value.  Thus, we can skip straight to
+       * quantizing the DC term.
+       */
+      MEMZERO(coef_blocks[bi], sizeof(JBLOCK));
+      coef_blocks[bi][0] =
+        quantize_coef((DCTELEM)(sample_data[0][start_col] - CENTERJSAMPLE) *
+                      DCTSIZE2, divisors);
+      continue;
+    }
+
+    if (cache != NULL &&
+        lookup_cached_block(cache, sample_data, start_col, coef_blocks[bi],
+                            &entry))
+      continue;
+
     /* Load data into workspace, applying unsigned->signed conversion */
     (*do_convsamp) (sample_data, start_col, workspace);
 
@@ -515,6 +731,9 @@ forward_DCT(j_compress_ptr cinfo, jpeg_component_info *compptr,
 
     /* Quantize/descale the coefficients, and store into coef_blocks[] */
     (*do_quantize) (coef_blocks[bi], divisors, workspace);
+
+    if (cache != NULL)
+      store_cached_block(entry, sample_data, start_col, coef_blocks[bi]);
   }
 }
 
@@ -587,6 +806,8 @@ forward_DCT_float(j_compress_ptr cinfo, jpeg_component_info *compptr,
   FAST_FLOAT *divisors = fdct->float_divisors[compptr->quant_tbl_no];
   FAST_FLOAT *workspace;
   JDIMENSION bi;
+  block_cache_segment *cache = NULL;
+  block_cache_entry *entry = NULL;
 
 
   /* Make sure the compiler doesn't look up these every pass */
@@ -594,10 +815,28 @@ forward_DCT_float(j_compress_ptr cinfo, jpeg_component_info *compptr,
   float_convsamp_method_ptr do_convsamp = fdct->float_convsamp;
   float_quantize_method_ptr do_quantize = fdct->float_quantize;
   workspace = fdct->float_workspace;
+  if (fdct->block_cache != NULL)
+    cache = fdct->block_cache->segments[compptr->quant_tbl_no];
 
   sample_data += start_row;     /* fold in the vertical offset once */
 
   for (bi = 0; bi < num_blocks; bi++, start_col += DCTSIZE) {
+    if (fdct->bypass_flat_blocks && is_flat_block(sample_data, start_col)) {
+      /* See forward_DCT().  The SIMD float quantizer rounds differently than
+       * quantize_float(), so we still let the quantizer handle the block.
+       */
+      MEMZERO(workspace, sizeof(FAST_FLOAT) * DCTSIZE2);
+      workspace[0] =
+        (FAST_FLOAT)((sample_data[0][start_col] - CENTERJSAMPLE) * DCTSIZE2);
+      (*do_quantize) (coef_blocks[bi], divisors, workspace);
+      continue;
+    }
+
+    if (cache != NULL &&
+        lookup_cached_block(cache, sample_data, start_col, coef_blocks[bi],
+                            &entry))
+      continue;
+
     /* Load data into workspace, applying unsigned->signed conversion */
     (*do_convsamp) (sample_data, start_col, workspace);
 
@@ -606,6 +845,9 @@ forward_DCT_float(j_compress_ptr cinfo, jpeg_component_info *compptr,
 
     /* Quantize/descale the coefficients, and store into coef_blocks[] */
     (*do_quantize) (coef_blocks[bi], divisors, workspace);
+
+    if (cache != NULL)
+      store_cached_block(entry, sample_data, start_col, coef_blocks[bi]);
   }
 }
 
@@ -627,6 +869,22 @@ jinit_forward_dct(j_compress_ptr cinfo)
                                 sizeof(my_fdct_controller));
   cinfo->fdct = (struct jpeg_forward_dct *)fdct;
   fdct->pub.start_pass = start_pass_fdctmgr;
+  fdct->block_cache = NULL;
+
+  /* The flat block bypass should never change the compressed output.  To
+   * allow that to be verified, the bypass can be disabled by setting the
+   * environment variable JPEG_NOFLATBYPASS to 1.  If your system doesn't
+   * support getenv(), define NO_GETENV to disable this feature.
+   */
+  fdct->bypass_flat_blocks = TRUE;
+#ifndef NO_GETENV
+  {
+    char *env;
+
+    if ((env = getenv("JPEG_NOFLATBYPASS")) != NULL && !strcmp(env, "1"))
+      fdct->bypass_flat_blocks = FALSE;
+  }
+#endif
 
   /* First determine the DCT... */
   switch (cinfo->dct_method) {
@@ -718,3 +976,64 @@ jinit_forward_dct(j_compress_ptr cinfo)
 #endif
   }
 }
+
+
+/*
+ * Enable the block reuse cache for the current image.  *cache_ptr should be
+ * NULL the first time this is called for a given compression object, in which
+ * case the cache is allocated and returned in *cache_ptr.  Passing the same
+ * pointer for subsequent images allows blocks to be reused across images.
+ * This must be called after jpeg_start_compress(), since the FDCT manager is
+ * re-created for each image.
+ */
+
+GLOBAL(void)
+jinit_fdct_block_cache(j_compress_ptr cinfo, void **cache_ptr)
+{
+  my_fdct_ptr fdct = (my_fdct_ptr)cinfo->fdct;
+  struct block_cache *cache = (struct block_cache *)*cache_ptr;
+  block_cache_segment *seg;
+  JQUANT_TBL *qtbl;
+  jpeg_component_info *compptr;
+  int ci, i;
+
+  if (cinfo->global_state != CSTATE_SCANNING &&
+      cinfo->global_state != CSTATE_RAW_OK)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  if (cache == NULL) {
+    cache = (struct block_cache *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                  sizeof(struct block_cache));
+    MEMZERO(cache, sizeof(struct block_cache));
+    *cache_ptr = (void *)cache;
+  }
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    /* start_pass_fdctmgr() has already validated the table number. */
+    qtbl = cinfo->quant_tbl_ptrs[compptr->quant_tbl_no];
+    seg = cache->segments[compptr->quant_tbl_no];
+    if (seg == NULL) {
+      seg = (block_cache_segment *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                    sizeof(block_cache_segment));
+      seg->entries = (block_cache_entry *)
+        (*cinfo->mem->alloc_large) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                    BLOCK_CACHE_SIZE *
+                                    sizeof(block_cache_entry));
+      cache->segments[compptr->quant_tbl_no] = seg;
+    } else if (seg->dct_method == cinfo->dct_method) {
+      for (i = 0; i < DCTSIZE2; i++)
+        if (seg->quantval[i] != qtbl->quantval[i])
+          break;
+      if (i == DCTSIZE2)
+        continue;               /* cached entries are still valid */
+    }
+    seg->dct_method = cinfo->dct_method;
+    MEMCOPY(seg->quantval, qtbl->quantval, sizeof(seg->quantval));
+    MEMZERO(seg->entries, BLOCK_CACHE_SIZE * sizeof(block_cache_entry));
+  }
+
+  fdct->block_cache = cache;
+}
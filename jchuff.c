@@ -28,6 +28,7 @@
 #include "jpeglib.h"
 #include "jsimd.h"
 #include "jconfigint.h"
+#include "jchuffbuf.h"
 #include <limits.h>
 
 /*
@@ -71,12 +72,6 @@
  * but must not be updated permanently until we complete the MCU.
  */
 
-#if defined(__x86_64__) && defined(__ILP32__)
-typedef unsigned long long bit_buf_type;
-#else
-typedef size_t bit_buf_type;
-#endif
-
 /* NOTE: The more optimal Huffman encoding algorithm is only used by the
  * intrinsics implementation of the Arm Neon SIMD extensions, which is why we
  * retain the old Huffman encoder behavior when using the GAS implementation.
@@ -88,14 +83,6 @@ typedef unsigned long long simd_bit_buf_type;
 typedef bit_buf_type simd_bit_buf_type;
 #endif
 
-#if (defined(SIZEOF_SIZE_T) && SIZEOF_SIZE_T == 8) || defined(_WIN64) || \
-    (defined(__x86_64__) && defined(__ILP32__))
-#define BIT_BUF_SIZE  64
-#elif (defined(SIZEOF_SIZE_T) && SIZEOF_SIZE_T == 4) || defined(_WIN32)
-#define BIT_BUF_SIZE  32
-#else
-#error Cannot determine word size
-#endif
 #define SIMD_BIT_BUF_SIZE  (sizeof(simd_bit_buf_type) * 8)
 
 typedef struct {
@@ -146,6 +133,14 @@ typedef struct {
 
 /* Forward declarations */
 METHODDEF(boolean) encode_mcu_huff(j_compress_ptr cinfo, JBLOCKROW *MCU_data);
+METHODDEF(boolean) encode_mcu_huff_gray(j_compress_ptr cinfo,
+                                       JBLOCKROW *MCU_data);
+METHODDEF(boolean) encode_mcu_huff_h1v1(j_compress_ptr cinfo,
+                                       JBLOCKROW *MCU_data);
+METHODDEF(boolean) encode_mcu_huff_h2v1(j_compress_ptr cinfo,
+                                       JBLOCKROW *MCU_data);
+METHODDEF(boolean) encode_mcu_huff_h2v2(j_compress_ptr cinfo,
+                                       JBLOCKROW *MCU_data);
 METHODDEF(void) finish_pass_huff(j_compress_ptr cinfo);
 #ifdef ENTROPY_OPT_SUPPORTED
 METHODDEF(boolean) encode_mcu_gather(j_compress_ptr cinfo,
@@ -175,7 +170,30 @@ start_pass_huff(j_compress_ptr cinfo, boolean gather_statistics)
     ERREXIT(cinfo, JERR_NOT_COMPILED);
 #endif
   } else {
+    int blkn, luma_blocks = cinfo->blocks_in_MCU - (cinfo->comps_in_scan - 1);
+    boolean specialize = (cinfo->comps_in_scan == 1 ||
+                          cinfo->comps_in_scan == 3);
+
+    /* Use a specialized encoder if the first component contributes 1, 2, or
+     * 4 blocks to the MCU and any others contribute one block each.  That
+     * covers grayscale, 4:4:4, 4:2:2, 4:4:0, and 4:2:0 with three components.
+     */
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU && specialize; blkn++) {
+      if (cinfo->MCU_membership[blkn] !=
+          (blkn < luma_blocks ? 0 : blkn - luma_blocks + 1))
+        specialize = FALSE;
+    }
     entropy->pub.encode_mcu = encode_mcu_huff;
+    if (specialize) {
+      if (cinfo->comps_in_scan == 1)
+        entropy->pub.encode_mcu = encode_mcu_huff_gray;
+      else if (luma_blocks == 1)
+        entropy->pub.encode_mcu = encode_mcu_huff_h1v1;
+      else if (luma_blocks == 2)
+        entropy->pub.encode_mcu = encode_mcu_huff_h2v1;
+      else if (luma_blocks == 4)
+        entropy->pub.encode_mcu = encode_mcu_huff_h2v2;
+    }
     entropy->pub.finish_pass = finish_pass_huff;
   }
 
@@ -380,7 +398,7 @@ dump_buffer(working_state *state)
 #if BIT_BUF_SIZE == 64
 
 #define FLUSH() { \
-  if (put_buffer & 0x8080808080808080 & ~(put_buffer + 0x0101010101010101)) { \
+  if (BIT_BUF_HAS_FF(put_buffer)) { \
     EMIT_BYTE(put_buffer >> 56) \
     EMIT_BYTE(put_buffer >> 48) \
     EMIT_BYTE(put_buffer >> 40) \
@@ -405,7 +423,7 @@ dump_buffer(working_state *state)
 #else
 
 #define FLUSH() { \
-  if (put_buffer & 0x80808080 & ~(put_buffer + 0x01010101)) { \
+  if (BIT_BUF_HAS_FF(put_buffer)) { \
     EMIT_BYTE(put_buffer >> 24) \
     EMIT_BYTE(put_buffer >> 16) \
     EMIT_BYTE(put_buffer >>  8) \
@@ -560,18 +578,20 @@ encode_one_block_simd(working_state *state, JCOEFPTR block, int last_dc_val,
   return TRUE;
 }
 
-LOCAL(boolean)
-encode_one_block(working_state *state, JCOEFPTR block, int last_dc_val,
-                 c_derived_tbl *dctbl, c_derived_tbl *actbl)
-{
-  int temp, nbits, free_bits;
-  bit_buf_type put_buffer;
-  JOCTET _buffer[BUFSIZE], *buffer;
-  int localbuf = 0;
+/* Encode a single block into buffer, which must have room for at least
+ * BUFSIZE bytes, using the bit buffer in *put_buffer_ptr and *free_bits_ptr.
+ * Returns the updated buffer pointer.  This is inlined into all of its
+ * callers, so the bit buffer can be held in registers across several blocks.
+ */
 
-  free_bits = state->cur.free_bits;
-  put_buffer = state->cur.put_buffer.c;
-  LOAD_BUFFER()
+INLINE
+LOCAL(JOCTET *)
+encode_one_block_core(JOCTET *buffer, bit_buf_type *put_buffer_ptr,
+                      int *free_bits_ptr, JCOEFPTR block, int last_dc_val,
+                      c_derived_tbl *dctbl, c_derived_tbl *actbl)
+{
+  int temp, nbits, free_bits = *free_bits_ptr;
+  bit_buf_type put_buffer = *put_buffer_ptr;
 
   /* Encode the DC coefficient difference per section F.1.2.1 */
 
@@ -644,8 +664,24 @@ encode_one_block(working_state *state, JCOEFPTR block, int last_dc_val,
     }
   }
 
-  state->cur.put_buffer.c = put_buffer;
-  state->cur.free_bits = free_bits;
+  *put_buffer_ptr = put_buffer;
+  *free_bits_ptr = free_bits;
+  return buffer;
+}
+
+LOCAL(boolean)
+encode_one_block(working_state *state, JCOEFPTR block, int last_dc_val,
+                 c_derived_tbl *dctbl, c_derived_tbl *actbl)
+{
+  JOCTET _buffer[BUFSIZE], *buffer;
+  int localbuf = 0;
+
+  LOAD_BUFFER()
+
+  buffer = encode_one_block_core(buffer, &state->cur.put_buffer.c,
+                                 &state->cur.free_bits, block, last_dc_val,
+                                 dctbl, actbl);
+
   STORE_BUFFER()
 
   return TRUE;
@@ -749,6 +785,134 @@ encode_mcu_huff(j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Specialized versions of encode_mcu_huff() for the common MCU layouts, in
+ * which the first component contributes luma_blocks adjacent blocks to the MCU
+ * and any others contribute one block each.  The table pointers and the DC
+ * predictor are held in local variables for each run of blocks, the output
+ * buffer is checked once per MCU rather than once per block, and (in the C
+ * path) the bit buffer stays in local variables for the whole MCU.
+ */
+
+#define MAX_LAYOUT_BLOCKS  6
+
+INLINE
+LOCAL(boolean)
+encode_mcu_huff_layout(j_compress_ptr cinfo, JBLOCKROW *MCU_data,
+                       int luma_blocks, int chroma_blocks)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr)cinfo->entropy;
+  working_state wstate, *state = &wstate;
+  JOCTET _buffer[BUFSIZE * MAX_LAYOUT_BLOCKS], *buffer;
+  int localbuf = 0;
+  int blkn, ci, nblocks, last_dc_val;
+  c_derived_tbl *dctbl, *actbl;
+  jpeg_component_info *compptr;
+
+  /* Load up working state */
+  wstate.next_output_byte = cinfo->dest->next_output_byte;
+  wstate.free_in_buffer = cinfo->dest->free_in_buffer;
+  wstate.cur = entropy->saved;
+  wstate.cinfo = cinfo;
+  wstate.simd = entropy->simd;
+
+  /* Emit restart marker if needed */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      if (!emit_restart(state, entropy->next_restart_num))
+        return FALSE;
+  }
+
+  if (wstate.free_in_buffer <
+      (size_t)(BUFSIZE * (luma_blocks + chroma_blocks))) {
+    localbuf = 1;
+    buffer = _buffer;
+  } else
+    buffer = wstate.next_output_byte;
+
+  /* Encode the MCU data blocks */
+  if (wstate.simd) {
+    blkn = 0;
+    for (ci = 0; ci <= chroma_blocks; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      dctbl = entropy->dc_derived_tbls[compptr->dc_tbl_no];
+      actbl = entropy->ac_derived_tbls[compptr->ac_tbl_no];
+      last_dc_val = wstate.cur.last_dc_val[ci];
+      for (nblocks = (ci ? 1 : luma_blocks); nblocks > 0; nblocks--, blkn++) {
+        buffer = jsimd_huff_encode_one_block(state, buffer, MCU_data[blkn][0],
+                                             last_dc_val, dctbl, actbl);
+        last_dc_val = MCU_data[blkn][0][0];
+      }
+      wstate.cur.last_dc_val[ci] = last_dc_val;
+    }
+  } else {
+    bit_buf_type put_buffer = wstate.cur.put_buffer.c;
+    int free_bits = wstate.cur.free_bits;
+
+    blkn = 0;
+    for (ci = 0; ci <= chroma_blocks; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      dctbl = entropy->dc_derived_tbls[compptr->dc_tbl_no];
+      actbl = entropy->ac_derived_tbls[compptr->ac_tbl_no];
+      last_dc_val = wstate.cur.last_dc_val[ci];
+      for (nblocks = (ci ? 1 : luma_blocks); nblocks > 0; nblocks--, blkn++) {
+        buffer = encode_one_block_core(buffer, &put_buffer, &free_bits,
+                                       MCU_data[blkn][0], last_dc_val, dctbl,
+                                       actbl);
+        last_dc_val = MCU_data[blkn][0][0];
+      }
+      wstate.cur.last_dc_val[ci] = last_dc_val;
+    }
+
+    wstate.cur.put_buffer.c = put_buffer;
+    wstate.cur.free_bits = free_bits;
+  }
+
+  STORE_BUFFER()
+
+  /* Completed MCU, so update state */
+  cinfo->dest->next_output_byte = wstate.next_output_byte;
+  cinfo->dest->free_in_buffer = wstate.free_in_buffer;
+  entropy->saved = wstate.cur;
+
+  /* Update restart-interval state too */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0) {
+      entropy->restarts_to_go = cinfo->restart_interval;
+      entropy->next_restart_num++;
+      entropy->next_restart_num &= 7;
+    }
+    entropy->restarts_to_go--;
+  }
+
+  return TRUE;
+}
+
+METHODDEF(boolean)
+encode_mcu_huff_gray(j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  return encode_mcu_huff_layout(cinfo, MCU_data, 1, 0);
+}
+
+METHODDEF(boolean)
+encode_mcu_huff_h1v1(j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  return encode_mcu_huff_layout(cinfo, MCU_data, 1, 2);
+}
+
+METHODDEF(boolean)
+encode_mcu_huff_h2v1(j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  return encode_mcu_huff_layout(cinfo, MCU_data, 2, 2);
+}
+
+METHODDEF(boolean)
+encode_mcu_huff_h2v2(j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  return encode_mcu_huff_layout(cinfo, MCU_data, 4, 2);
+}
+
+
 /*
  * Finish up at the end of a Huffman-compressed scan.
  */
@@ -808,11 +972,7 @@ htest_one_block(j_compress_ptr cinfo, JCOEFPTR block, int last_dc_val,
     temp = -temp;
 
   /* Find the number of bits needed for the magnitude of the coefficient */
-  nbits = 0;
-  while (temp) {
-    nbits++;
-    temp >>= 1;
-  }
+  nbits = JPEG_NBITS(temp);
   /* Check for out-of-range coefficient values.
    * Since we're encoding a difference, the range limit is twice as much.
    */
@@ -831,19 +991,13 @@ htest_one_block(j_compress_ptr cinfo, JCOEFPTR block, int last_dc_val,
       r++;
     } else {
       /* if run length > 15, must emit special run-length-16 codes (0xF0) */
-      while (r > 15) {
-        ac_counts[0xF0]++;
-        r -= 16;
-      }
+      ac_counts[0xF0] += r >> 4;
+      r &= 15;
 
       /* Find the number of bits needed for the magnitude of the coefficient */
       if (temp < 0)
         temp = -temp;
-
-      /* Find the number of bits needed for the magnitude of the coefficient */
-      nbits = 1;                /* there must be at least one 1 bit */
-      while ((temp >>= 1))
-        nbits++;
+      nbits = JPEG_NBITS_NONZERO(temp);
       /* Check for out-of-range coefficient values */
       if (nbits > MAX_COEF_BITS)
         ERREXIT(cinfo, JERR_BAD_DCT_COEF);
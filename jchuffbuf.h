@@ -0,0 +1,49 @@
+/*
+ * jchuffbuf.h
+ *
+ * This file was part of the Independent JPEG Group's software:
+ * Copyright (C) 1991-1997, Thomas G. Lane.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2009-2011, 2014-2016, 2018-2021, D. R. Commander.
+ * For conditions of distribution and use, see the accompanying README.ijg
+ * file.
+ *
+ * This file defines the bit buffer that is shared between the sequential
+ * Huffman encoder (jchuff.c) and the progressive Huffman encoder (jcphuff.c).
+ * It must be included after jconfigint.h.
+ */
+
+#ifndef JCHUFFBUF_H
+#define JCHUFFBUF_H
+
+/* The bit buffer is a full machine word, so that it can be flushed a word at
+ * a time.
+ */
+
+#if defined(__x86_64__) && defined(__ILP32__)
+typedef unsigned long long bit_buf_type;
+#else
+typedef size_t bit_buf_type;
+#endif
+
+#if (defined(SIZEOF_SIZE_T) && SIZEOF_SIZE_T == 8) || defined(_WIN64) || \
+    (defined(__x86_64__) && defined(__ILP32__))
+#define BIT_BUF_SIZE  64
+#elif (defined(SIZEOF_SIZE_T) && SIZEOF_SIZE_T == 4) || defined(_WIN32)
+#define BIT_BUF_SIZE  32
+#else
+#error Cannot determine word size
+#endif
+
+/* Nonzero if any byte of the bit buffer x is 0xFF.  This tests all bytes at
+ * once.
+ */
+
+#if BIT_BUF_SIZE == 64
+#define BIT_BUF_HAS_FF(x) \
+  ((x) & 0x8080808080808080 & ~((x) + 0x0101010101010101))
+#else
+#define BIT_BUF_HAS_FF(x)  ((x) & 0x80808080 & ~((x) + 0x01010101))
+#endif
+
+#endif /* JCHUFFBUF_H */
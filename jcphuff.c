@@ -22,6 +22,7 @@
 #include "jpeglib.h"
 #include "jsimd.h"
 #include "jconfigint.h"
+#include "jchuffbuf.h"
 #include <limits.h>
 
 #ifdef HAVE_INTRIN_H
@@ -95,8 +96,8 @@ typedef struct {
    */
   JOCTET *next_output_byte;     /* => next byte to write in buffer */
   size_t free_in_buffer;        /* # of byte spaces remaining in buffer */
-  size_t put_buffer;            /* current bit-accumulation buffer */
-  int put_bits;                 /* # of bits now in it */
+  bit_buf_type put_buffer;      /* current bit-accumulation buffer */
+  int free_bits;                /* # of bits available in it */
   j_compress_ptr cinfo;         /* link to cinfo (needed for dump_buffer) */
 
   /* Coding status for DC components */
@@ -288,7 +289,7 @@ start_pass_phuff(j_compress_ptr cinfo, boolean gather_statistics)
 
   /* Initialize bit buffer to empty */
   entropy->put_buffer = 0;
-  entropy->put_bits = 0;
+  entropy->free_bits = BIT_BUF_SIZE;
 
   /* Initialize restart stuff */
   entropy->restarts_to_go = cinfo->restart_interval;
@@ -325,10 +326,41 @@ dump_buffer(phuff_entropy_ptr entropy)
 
 /* Outputting bits to the file */
 
-/* Only the right 24 bits of put_buffer are used; the valid bits are
- * left-justified in this part.  At most 16 bits can be passed to emit_bits
- * in one call, and we never retain more than 7 bits in put_buffer
- * between calls, so 24 bits are sufficient.
+/* Output the entire bit buffer.  If there are no 0xFF bytes in it (which is
+ * tested for all bytes at once) and there is room for it in the output
+ * buffer, then write it directly.  Otherwise, emit it one byte at a time,
+ * encoding 0xFF as 0xFF 0x00.
+ */
+
+LOCAL(void)
+flush_put_buffer(phuff_entropy_ptr entropy, bit_buf_type put_buffer)
+{
+  int shift, c;
+
+  if (!BIT_BUF_HAS_FF(put_buffer) &&
+      entropy->free_in_buffer > BIT_BUF_SIZE / 8) {
+    JOCTET *buffer = entropy->next_output_byte;
+
+    for (shift = BIT_BUF_SIZE - 8; shift >= 0; shift -= 8)
+      *buffer++ = (JOCTET)(put_buffer >> shift);
+    entropy->next_output_byte = buffer;
+    entropy->free_in_buffer -= BIT_BUF_SIZE / 8;
+  } else {
+    for (shift = BIT_BUF_SIZE - 8; shift >= 0; shift -= 8) {
+      c = (int)((put_buffer >> shift) & 0xFF);
+      emit_byte(entropy, c);
+      if (c == 0xFF) {          /* need to stuff a zero byte? */
+        emit_byte(entropy, 0);
+      }
+    }
+  }
+}
+
+
+/* The valid bits in put_buffer are right-justified, and free_bits is the
+ * number of unused bits above them.  At most 16 bits can be passed to
+ * emit_bits in one call.  When the bit buffer fills up, it is flushed in its
+ * entirety.
  */
 
 LOCAL(void)
@@ -336,8 +368,8 @@ emit_bits(phuff_entropy_ptr entropy, unsigned int code, int size)
 /* Emit some bits, unless we are in gather mode */
 {
   /* This routine is heavily used, so it's worth coding tightly. */
-  register size_t put_buffer = (size_t)code;
-  register int put_bits = entropy->put_bits;
+  register bit_buf_type put_buffer;
+  register int free_bits;
 
   /* if size is 0, caller used an invalid Huffman table entry */
   if (size == 0)
@@ -346,36 +378,53 @@ emit_bits(phuff_entropy_ptr entropy, unsigned int code, int size)
   if (entropy->gather_statistics)
     return;                     /* do nothing if we're only getting stats */
 
-  put_buffer &= (((size_t)1) << size) - 1; /* mask off any extra bits in code */
+  code &= (1U << size) - 1;     /* mask off any extra bits in code */
 
-  put_bits += size;             /* new number of bits in buffer */
+  put_buffer = entropy->put_buffer;
+  free_bits = entropy->free_bits - size;
 
-  put_buffer <<= 24 - put_bits; /* align incoming bits */
+  if (free_bits < 0) {
+    /* Fill the bit buffer to capacity with the leading bits from code, output
+     * the bit buffer, and put the remaining bits from code into it.
+     */
+    put_buffer = (put_buffer << (size + free_bits)) | (code >> -free_bits);
+    flush_put_buffer(entropy, put_buffer);
+    free_bits += BIT_BUF_SIZE;
+    put_buffer = code;
+  } else
+    put_buffer = (put_buffer << size) | code;
 
-  put_buffer |= entropy->put_buffer; /* and merge with old buffer contents */
+  entropy->put_buffer = put_buffer; /* update variables */
+  entropy->free_bits = free_bits;
+}
 
-  while (put_bits >= 8) {
-    int c = (int)((put_buffer >> 16) & 0xFF);
 
+LOCAL(void)
+flush_bits(phuff_entropy_ptr entropy)
+{
+  bit_buf_type put_buffer = entropy->put_buffer;
+  int put_bits = BIT_BUF_SIZE - entropy->free_bits;
+  int c;
+
+  while (put_bits >= 8) {
+    put_bits -= 8;
+    c = (int)((put_buffer >> put_bits) & 0xFF);
     emit_byte(entropy, c);
     if (c == 0xFF) {            /* need to stuff a zero byte? */
       emit_byte(entropy, 0);
     }
-    put_buffer <<= 8;
-    put_bits -= 8;
+  }
+  if (put_bits) {
+    /* fill partial byte with ones */
+    c = (int)(((put_buffer << (8 - put_bits)) | (0xFF >> put_bits)) & 0xFF);
+    emit_byte(entropy, c);
+    if (c == 0xFF) {
+      emit_byte(entropy, 0);
+    }
   }
 
-  entropy->put_buffer = put_buffer; /* update variables */
-  entropy->put_bits = put_bits;
-}
-
-
-LOCAL(void)
-flush_bits(phuff_entropy_ptr entropy)
-{
-  emit_bits(entropy, 0x7F, 7); /* fill any partial byte with ones */
-  entropy->put_buffer = 0;     /* and reset bit-buffer to empty */
-  entropy->put_bits = 0;
+  entropy->put_buffer = 0;      /* and reset bit-buffer to empty */
+  entropy->free_bits = BIT_BUF_SIZE;
 }
 
 
@@ -403,13 +452,23 @@ LOCAL(void)
 emit_buffered_bits(phuff_entropy_ptr entropy, char *bufstart,
                    unsigned int nbits)
 {
+  unsigned int code;
+  int size, i;
+
   if (entropy->gather_statistics)
     return;                     /* no real work */
 
+  /* Pack the correction bits (one per char) into codes of up to 16 bits, so
+   * that the bit buffer is updated once per 16 bits rather than once per bit.
+   */
   while (nbits > 0) {
-    emit_bits(entropy, (unsigned int)(*bufstart), 1);
-    bufstart++;
-    nbits--;
+    size = (int)MIN(nbits, 16);
+    code = 0;
+    for (i = 0; i < size; i++)
+      code = (code << 1) | (unsigned int)(bufstart[i] & 1);
+    emit_bits(entropy, code, size);
+    bufstart += size;
+    nbits -= size;
   }
 }
 
@@ -249,6 +249,31 @@ jpeg_crop_scanline(j_decompress_ptr cinfo, JDIMENSION *xoffset,
 }
 
 
+/*
+ * Determine how many output rows jpeg_read_scanlines() asks the main
+ * controller for at once when the application supplies a large buffer: as
+ * many whole iMCU rows as fit in READ_STRIPE_BYTES of output, but at least
+ * one.  This amortizes the per-call overhead of the main, postprocessing, and
+ * upsampling controllers while still calling the progress monitor (which an
+ * application may use to abort decompression) at regular intervals.
+ */
+
+#define READ_STRIPE_BYTES  (256 * 1024)
+
+LOCAL(JDIMENSION)
+read_stripe_height(j_decompress_ptr cinfo)
+{
+  JDIMENSION imcu_height, row_bytes, num_imcu_rows;
+
+  imcu_height = (JDIMENSION)(cinfo->max_v_samp_factor *
+                             cinfo->_min_DCT_scaled_size);
+  row_bytes = cinfo->output_width * cinfo->out_color_components *
+              sizeof(JSAMPLE);
+  num_imcu_rows = READ_STRIPE_BYTES / MAX(imcu_height * row_bytes, 1);
+  return imcu_height * MAX(num_imcu_rows, 1);
+}
+
+
 /*
  * Read some scanlines of data from the JPEG decompressor.
  *
@@ -266,7 +291,7 @@ GLOBAL(JDIMENSION)
 jpeg_read_scanlines(j_decompress_ptr cinfo, JSAMPARRAY scanlines,
                     JDIMENSION max_lines)
 {
-  JDIMENSION row_ctr;
+  JDIMENSION row_ctr, stripe_end, stripe_height;
 
   if (cinfo->global_state != DSTATE_SCANNING)
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
@@ -282,9 +307,26 @@ jpeg_read_scanlines(j_decompress_ptr cinfo, JSAMPARRAY scanlines,
     (*cinfo->progress->progress_monitor) ((j_common_ptr)cinfo);
   }
 
-  /* Process some data */
+  /* Process some data.  The main controller fills as much of the buffer as
+   * it can, so a large request is split into stripes of whole iMCU rows, and
+   * the progress monitor is called between stripes.
+   */
+  if (max_lines > cinfo->output_height - cinfo->output_scanline)
+    max_lines = cinfo->output_height - cinfo->output_scanline;
+  stripe_height = read_stripe_height(cinfo);
   row_ctr = 0;
-  (*cinfo->main->process_data) (cinfo, scanlines, &row_ctr, max_lines);
+  for (;;) {
+    stripe_end = max_lines;
+    if (stripe_end - row_ctr > stripe_height)
+      stripe_end = row_ctr + stripe_height;
+    (*cinfo->main->process_data) (cinfo, scanlines, &row_ctr, stripe_end);
+    if (row_ctr < stripe_end || row_ctr >= max_lines)
+      break;                    /* suspension forced or request satisfied */
+    if (cinfo->progress != NULL) {
+      cinfo->progress->pass_counter = (long)(cinfo->output_scanline + row_ctr);
+      (*cinfo->progress->progress_monitor) ((j_common_ptr)cinfo);
+    }
+  }
   cinfo->output_scanline += row_ctr;
   return row_ctr;
 }
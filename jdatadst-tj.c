@@ -193,6 +193,14 @@ jpeg_mem_dest_tj(j_compress_ptr cinfo, unsigned char **outbuffer,
       *outsize = OUTPUT_BUF_SIZE;
     } else
       ERREXIT(cinfo, JERR_BUFFER_SIZE);
+  } else if (alloc && !reused) {
+    /* The application's buffer was allocated with tjAlloc(), so it is ours to
+     * free if it has to be grown.  Otherwise, empty_mem_output_buffer() would
+     * free whichever buffer was allocated for a previous image, which the
+     * application may still be using when compressing into several buffers
+     * with the same instance.
+     */
+    dest->newbuffer = *outbuffer;
   }
 
   dest->pub.next_output_byte = dest->buffer = *outbuffer;
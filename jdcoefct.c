@@ -56,8 +56,19 @@ start_input_pass(j_decompress_ptr cinfo)
 METHODDEF(void)
 start_output_pass(j_decompress_ptr cinfo)
 {
-#ifdef BLOCK_SMOOTHING_SUPPORTED
+#if defined(D_MULTISCAN_FILES_SUPPORTED) || defined(BLOCK_SMOOTHING_SUPPORTED)
   my_coef_ptr coef = (my_coef_ptr)cinfo->coef;
+#endif
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+  int ci;
+
+  /* The IDCT method and scaling may change between output passes, so forget
+   * any cached DC-only blocks.
+   */
+  for (ci = 0; ci < MAX_COMPONENTS; ci++)
+    coef->dc_only_valid[ci] = FALSE;
+#endif
+#ifdef BLOCK_SMOOTHING_SUPPORTED
 
   /* If multipass, check to see whether to use block smoothing on this pass */
   if (coef->pub.coef_arrays != NULL) {
@@ -253,6 +264,22 @@ consume_data(j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Return TRUE if all AC coefficients of the block are zero.
+ */
+
+LOCAL(boolean)
+is_dc_only(JCOEFPTR coef_block)
+{
+  JCOEF acc = 0;
+  int k;
+
+  for (k = 1; k < DCTSIZE2; k++)
+    acc |= coef_block[k];
+  return acc == 0;
+}
+
+
 /*
  * Decompress and return some data in the multi-pass case.
  * Always attempts to emit one fully interleaved MCU row ("iMCU" row).
@@ -274,6 +301,8 @@ decompress_data(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JDIMENSION output_col;
   jpeg_component_info *compptr;
   inverse_DCT_method_ptr inverse_DCT;
+  JSAMPLE *dc_only_samples;
+  int size, row;
 
   /* Force some input to be done if we are getting ahead of the input. */
   while (cinfo->input_scan_number < cinfo->output_scan_number ||
@@ -304,18 +333,43 @@ decompress_data(j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     }
     inverse_DCT = cinfo->idct->inverse_DCT[ci];
     output_ptr = output_buf[ci];
+    size = compptr->_DCT_scaled_size;
+    dc_only_samples = coef->dc_only_samples[ci];
     /* Loop over all DCT blocks to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
       buffer_ptr = buffer[block_row] + cinfo->master->first_MCU_col[ci];
       output_col = 0;
       for (block_num = cinfo->master->first_MCU_col[ci];
            block_num <= cinfo->master->last_MCU_col[ci]; block_num++) {
-        (*inverse_DCT) (cinfo, compptr, (JCOEFPTR)buffer_ptr, output_ptr,
-                        output_col);
+        /* Blocks with no AC coefficients are common in the fully buffered
+         * case (flat image areas, chroma, and low-quality progressive
+         * images), and the IDCT output depends only on the coefficients.
+         * Thus, if this block is DC-only and has the same DC value as the
+         * last DC-only block in this component, then copy the output of that
+         * block rather than running the IDCT again.
+         */
+        if (is_dc_only((JCOEFPTR)buffer_ptr)) {
+          if (coef->dc_only_valid[ci] &&
+              coef->dc_only_value[ci] == buffer_ptr[0][0]) {
+            for (row = 0; row < size; row++)
+              MEMCOPY(output_ptr[row] + output_col,
+                      dc_only_samples + row * size, size * sizeof(JSAMPLE));
+          } else {
+            (*inverse_DCT) (cinfo, compptr, (JCOEFPTR)buffer_ptr, output_ptr,
+                            output_col);
+            for (row = 0; row < size; row++)
+              MEMCOPY(dc_only_samples + row * size,
+                      output_ptr[row] + output_col, size * sizeof(JSAMPLE));
+            coef->dc_only_value[ci] = buffer_ptr[0][0];
+            coef->dc_only_valid[ci] = TRUE;
+          }
+        } else
+          (*inverse_DCT) (cinfo, compptr, (JCOEFPTR)buffer_ptr, output_ptr,
+                          output_col);
         buffer_ptr++;
-        output_col += compptr->_DCT_scaled_size;
+        output_col += size;
       }
-      output_ptr += compptr->_DCT_scaled_size;
+      output_ptr += size;
     }
   }
 
@@ -852,6 +906,12 @@ jinit_d_coef_controller(j_decompress_ptr cinfo, boolean need_full_buffer)
     coef->pub.consume_data = consume_data;
     coef->pub.decompress_data = decompress_data;
     coef->pub.coef_arrays = coef->whole_image; /* link to virtual arrays */
+
+    /* Allocate DC-only block caches big enough for the largest IDCT size */
+    for (ci = 0; ci < cinfo->num_components; ci++)
+      coef->dc_only_samples[ci] = (JSAMPLE *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
+                                    DCTSIZE2 * 4 * sizeof(JSAMPLE));
 #else
     ERREXIT(cinfo, JERR_NOT_COMPILED);
 #endif
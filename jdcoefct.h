@@ -47,6 +47,14 @@ typedef struct {
 #ifdef D_MULTISCAN_FILES_SUPPORTED
   /* In multi-pass modes, we need a virtual block array for each component. */
   jvirt_barray_ptr whole_image[MAX_COMPONENTS];
+
+  /* In multi-pass modes, the IDCT output for the most recent DC-only block
+   * of each component, which is reused for subsequent DC-only blocks with
+   * the same DC value (see decompress_data())
+   */
+  JSAMPLE *dc_only_samples[MAX_COMPONENTS];
+  JCOEF dc_only_value[MAX_COMPONENTS];
+  boolean dc_only_valid[MAX_COMPONENTS];
 #endif
 
 #ifdef BLOCK_SMOOTHING_SUPPORTED
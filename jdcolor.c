@@ -18,6 +18,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jsimd.h"
+#include "jdycctab.h"
 #include "jconfigint.h"
 
 
@@ -27,13 +28,13 @@ typedef struct {
   struct jpeg_color_deconverter pub; /* public fields */
 
   /* Private state for YCC->RGB conversion */
-  int *Cr_r_tab;                /* => table for Cr to R conversion */
-  int *Cb_b_tab;                /* => table for Cb to B conversion */
-  JLONG *Cr_g_tab;              /* => table for Cr to G conversion */
-  JLONG *Cb_g_tab;              /* => table for Cb to G conversion */
+  const int *Cr_r_tab;          /* => table for Cr to R conversion */
+  const int *Cb_b_tab;          /* => table for Cb to B conversion */
+  const JLONG *Cr_g_tab;        /* => table for Cr to G conversion */
+  const JLONG *Cb_g_tab;        /* => table for Cb to G conversion */
 
   /* Private state for RGB->Y conversion */
-  JLONG *rgb_y_tab;             /* => table for RGB to Y conversion */
+  const JLONG *rgb_y_tab;       /* => table for RGB to Y conversion */
 } my_color_deconverter;
 
 typedef my_color_deconverter *my_cconvert_ptr;
@@ -77,8 +78,8 @@ typedef my_color_deconverter *my_cconvert_ptr;
 #define ONE_HALF        ((JLONG)1 << (SCALEBITS - 1))
 #define FIX(x)          ((JLONG)((x) * (1L << SCALEBITS) + 0.5))
 
-/* We allocate one big table for RGB->Y conversion and divide it up into
- * three parts, instead of doing three alloc_small requests.  This lets us
+/* We use one big table for RGB->Y conversion and divide it up into
+ * three parts, instead of using three separate tables.  This lets us
  * use a single table base address, which can be held in a register in the
  * inner loops on many machines (more than can hold all three addresses,
  * anyway).
@@ -90,6 +91,72 @@ typedef my_color_deconverter *my_cconvert_ptr;
 #define TABLE_SIZE      (3 * (MAXJSAMPLE + 1))
 
 
+/* YCC->RGB tables (shared with jdmerge.c) */
+
+/* Expand f(i) for each sample value i from 0 to MAXJSAMPLE */
+
+#define JTAB4(f, i) \
+  f(i), f((i) + 1), f((i) + 2), f((i) + 3)
+#define JTAB16(f, i) \
+  JTAB4(f, i), JTAB4(f, (i) + 4), JTAB4(f, (i) + 8), JTAB4(f, (i) + 12)
+#define JTAB64(f, i) \
+  JTAB16(f, i), JTAB16(f, (i) + 16), JTAB16(f, (i) + 32), \
+  JTAB16(f, (i) + 48)
+#define JTAB256(f, i) \
+  JTAB64(f, i), JTAB64(f, (i) + 64), JTAB64(f, (i) + 128), \
+  JTAB64(f, (i) + 192)
+
+#if BITS_IN_JSAMPLE == 8
+#define JTAB_SAMPLES(f)  JTAB256(f, 0)
+#else
+#define JTAB1024(f, i) \
+  JTAB256(f, i), JTAB256(f, (i) + 256), JTAB256(f, (i) + 512), \
+  JTAB256(f, (i) + 768)
+#define JTAB4096(f, i) \
+  JTAB1024(f, i), JTAB1024(f, (i) + 1024), JTAB1024(f, (i) + 2048), \
+  JTAB1024(f, (i) + 3072)
+#define JTAB_SAMPLES(f)  JTAB4096(f, 0)
+#endif
+
+/* Signed right shift by SCALEBITS that is usable in a constant expression
+ * (RIGHT_SHIFT() may not be.)  This rounds towards minus infinity, as
+ * RIGHT_SHIFT() does.
+ */
+#define CONST_DESCALE(x) \
+  ((x) >= 0 ? (x) >> SCALEBITS : ~(~(x) >> SCALEBITS))
+
+/* i is the actual input pixel value, in the range 0..MAXJSAMPLE.  The Cb or
+ * Cr value we are thinking of is x = i - CENTERJSAMPLE.
+ */
+
+/* Cr=>R value is nearest int to 1.40200 * x */
+#define CR_R(i) \
+  (int)CONST_DESCALE(FIX(1.40200) * ((i) - CENTERJSAMPLE) + ONE_HALF)
+/* Cb=>B value is nearest int to 1.77200 * x */
+#define CB_B(i) \
+  (int)CONST_DESCALE(FIX(1.77200) * ((i) - CENTERJSAMPLE) + ONE_HALF)
+/* Cr=>G value is scaled-up -0.71414 * x */
+#define CR_G(i)  ((-FIX(0.71414)) * ((i) - CENTERJSAMPLE))
+/* Cb=>G value is scaled-up -0.34414 * x */
+/* We also add in ONE_HALF so that need not do it in inner loop */
+#define CB_G(i)  ((-FIX(0.34414)) * ((i) - CENTERJSAMPLE) + ONE_HALF)
+
+const int jpeg_ycc_Cr_r_tab[MAXJSAMPLE + 1] = { JTAB_SAMPLES(CR_R) };
+const int jpeg_ycc_Cb_b_tab[MAXJSAMPLE + 1] = { JTAB_SAMPLES(CB_B) };
+const JLONG jpeg_ycc_Cr_g_tab[MAXJSAMPLE + 1] = { JTAB_SAMPLES(CR_G) };
+const JLONG jpeg_ycc_Cb_g_tab[MAXJSAMPLE + 1] = { JTAB_SAMPLES(CB_G) };
+
+/* RGB->Y table, likewise fixed at compile time */
+
+#define R_Y(i)  (FIX(0.29900) * (i))
+#define G_Y(i)  (FIX(0.58700) * (i))
+#define B_Y(i)  (FIX(0.11400) * (i) + ONE_HALF)
+
+static const JLONG rgb_y_table[TABLE_SIZE] = {
+  JTAB_SAMPLES(R_Y), JTAB_SAMPLES(G_Y), JTAB_SAMPLES(B_Y)
+};
+
+
 /* Include inline routines for colorspace extensions */
 
 #include "jdcolext.c"
@@ -211,38 +278,11 @@ LOCAL(void)
 build_ycc_rgb_table(j_decompress_ptr cinfo)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr)cinfo->cconvert;
-  int i;
-  JLONG x;
-  SHIFT_TEMPS
 
-  cconvert->Cr_r_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                (MAXJSAMPLE + 1) * sizeof(int));
-  cconvert->Cb_b_tab = (int *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                (MAXJSAMPLE + 1) * sizeof(int));
-  cconvert->Cr_g_tab = (JLONG *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                (MAXJSAMPLE + 1) * sizeof(JLONG));
-  cconvert->Cb_g_tab = (JLONG *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                (MAXJSAMPLE + 1) * sizeof(JLONG));
-
-  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
-    /* i is the actual input pixel value, in the range 0..MAXJSAMPLE */
-    /* The Cb or Cr value we are thinking of is x = i - CENTERJSAMPLE */
-    /* Cr=>R value is nearest int to 1.40200 * x */
-    cconvert->Cr_r_tab[i] = (int)
-                    RIGHT_SHIFT(FIX(1.40200) * x + ONE_HALF, SCALEBITS);
-    /* Cb=>B value is nearest int to 1.77200 * x */
-    cconvert->Cb_b_tab[i] = (int)
-                    RIGHT_SHIFT(FIX(1.77200) * x + ONE_HALF, SCALEBITS);
-    /* Cr=>G value is scaled-up -0.71414 * x */
-    cconvert->Cr_g_tab[i] = (-FIX(0.71414)) * x;
-    /* Cb=>G value is scaled-up -0.34414 * x */
-    /* We also add in ONE_HALF so that need not do it in inner loop */
-    cconvert->Cb_g_tab[i] = (-FIX(0.34414)) * x + ONE_HALF;
-  }
+  cconvert->Cr_r_tab = jpeg_ycc_Cr_r_tab;
+  cconvert->Cb_b_tab = jpeg_ycc_Cb_b_tab;
+  cconvert->Cr_g_tab = jpeg_ycc_Cr_g_tab;
+  cconvert->Cb_g_tab = jpeg_ycc_Cb_g_tab;
 }
 
 
@@ -302,19 +342,8 @@ LOCAL(void)
 build_rgb_y_table(j_decompress_ptr cinfo)
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr)cinfo->cconvert;
-  JLONG *rgb_y_tab;
-  JLONG i;
-
-  /* Allocate and fill in the conversion tables. */
-  cconvert->rgb_y_tab = rgb_y_tab = (JLONG *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                (TABLE_SIZE * sizeof(JLONG)));
 
-  for (i = 0; i <= MAXJSAMPLE; i++) {
-    rgb_y_tab[i + R_Y_OFF] = FIX(0.29900) * i;
-    rgb_y_tab[i + G_Y_OFF] = FIX(0.58700) * i;
-    rgb_y_tab[i + B_Y_OFF] = FIX(0.11400) * i + ONE_HALF;
-  }
+  cconvert->rgb_y_tab = rgb_y_table;
 }
 
 
@@ -328,7 +357,7 @@ rgb_gray_convert(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
 {
   my_cconvert_ptr cconvert = (my_cconvert_ptr)cinfo->cconvert;
   register int r, g, b;
-  register JLONG *ctab = cconvert->rgb_y_tab;
+  register const JLONG *ctab = cconvert->rgb_y_tab;
   register JSAMPROW outptr;
   register JSAMPROW inptr0, inptr1, inptr2;
   register JDIMENSION col;
@@ -536,10 +565,10 @@ ycck_cmyk_convert(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
   JDIMENSION num_cols = cinfo->output_width;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  register int *Crrtab = cconvert->Cr_r_tab;
-  register int *Cbbtab = cconvert->Cb_b_tab;
-  register JLONG *Crgtab = cconvert->Cr_g_tab;
-  register JLONG *Cbgtab = cconvert->Cb_g_tab;
+  register const int *Crrtab = cconvert->Cr_r_tab;
+  register const int *Cbbtab = cconvert->Cb_b_tab;
+  register const JLONG *Crgtab = cconvert->Cr_g_tab;
+  register const JLONG *Cbgtab = cconvert->Cb_g_tab;
   SHIFT_TEMPS
 
   while (--num_rows >= 0) {
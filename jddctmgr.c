@@ -87,6 +87,47 @@ typedef union {
 #endif
 
 
+/*
+ * Choose the IDCT method for a component when dct_method is JDCT_AUTO.
+ *
+ * Compared to the accurate integer IDCT, the fast integer IDCT adds a roughly
+ * constant amount of error to the output samples (a mean squared error of
+ * about 1 to 2, more for very fine quantization tables), whereas the error
+ * already introduced by quantization grows with the quantization step sizes.
+ * Thus, we use the fast IDCT only if the mean of the component's 64
+ * quantization steps is at least AUTO_IFAST_MIN_MEAN_QUANT.
+ * With the standard tables, that corresponds to a quality of about 86 or
+ * below for luminance and 90 or below for chrominance, and the fast IDCT
+ * increases the mean squared error of the decompressed image by no more than
+ * about 20% (less than 1 dB PSNR.)
+ */
+
+#define AUTO_IFAST_MIN_MEAN_QUANT  16
+
+LOCAL(J_DCT_METHOD)
+select_auto_method(jpeg_component_info *compptr)
+{
+#if defined(DCT_IFAST_SUPPORTED) && defined(DCT_ISLOW_SUPPORTED)
+  JQUANT_TBL *qtbl = compptr->quant_table;
+  long sum = 0;
+  int i;
+
+  /* If no quant table has yet been saved for the component, then the choice
+   * doesn't matter; we'll choose again at the next output pass.
+   */
+  if (qtbl == NULL)
+    return JDCT_ISLOW;
+  for (i = 0; i < DCTSIZE2; i++)
+    sum += qtbl->quantval[i];
+  return sum >= AUTO_IFAST_MIN_MEAN_QUANT * DCTSIZE2 ? JDCT_IFAST : JDCT_ISLOW;
+#elif defined(DCT_IFAST_SUPPORTED)
+  return JDCT_IFAST;
+#else
+  return JDCT_ISLOW;
+#endif
+}
+
+
 /*
  * Prepare for an output pass.
  * Here we select the proper IDCT routine for each component and build
@@ -100,6 +141,7 @@ start_pass(j_decompress_ptr cinfo)
   int ci, i;
   jpeg_component_info *compptr;
   int method = 0;
+  J_DCT_METHOD dct_method;
   inverse_DCT_method_ptr method_ptr = NULL;
   JQUANT_TBL *qtbl;
 
@@ -149,7 +191,10 @@ start_pass(j_decompress_ptr cinfo)
       break;
 #endif
     case DCTSIZE:
-      switch (cinfo->dct_method) {
+      dct_method = cinfo->dct_method;
+      if (dct_method == JDCT_AUTO)
+        dct_method = select_auto_method(compptr);
+      switch (dct_method) {
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
         if (jsimd_can_idct_islow())
@@ -52,7 +52,9 @@ typedef struct {
   /* These fields are NOT loaded into local working state. */
   unsigned int restarts_to_go;  /* MCUs left in this restart interval */
 
-  /* Pointers to derived tables (these workspaces have image lifespan) */
+  /* Pointers to derived tables (these workspaces have image lifespan, unless
+   * the derived table cache is enabled)
+   */
   d_derived_tbl *dc_derived_tbls[NUM_HUFF_TBLS];
   d_derived_tbl *ac_derived_tbls[NUM_HUFF_TBLS];
 
@@ -130,9 +132,59 @@ start_pass_huff_decoder(j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Computing the derived tables takes a significant fraction of the time
+ * needed to decompress a small image, and Motion-JPEG streams in particular
+ * use the same Huffman tables (often the standard tables, in which case the
+ * frames omit them) for every frame.  Thus, the derived tables can optionally
+ * be cached in the permanent pool, one entry per table slot, and an entry is
+ * recomputed only if the Huffman table in that slot has changed since it was
+ * derived.  The cache is about 13 KB, so it is enabled only by callers that
+ * decompress many images with the same object (see
+ * jinit_d_derived_tbl_cache()).
+ */
+
+typedef struct {
+  boolean valid;                /* TRUE if dtbl was derived from the table */
+  UINT8 bits[17];               /* Huffman table from which dtbl was derived */
+  UINT8 huffval[256];
+  d_derived_tbl dtbl;
+} derived_tbl_cache_entry;
+
+struct derived_tbl_cache {
+  derived_tbl_cache_entry dc[NUM_HUFF_TBLS];
+  derived_tbl_cache_entry ac[NUM_HUFF_TBLS];
+};
+
+
+/*
+ * Enable the derived table cache for this decompression object.  The cache
+ * persists until the object is destroyed.  This may be called only between
+ * images.
+ */
+
+GLOBAL(void)
+jinit_d_derived_tbl_cache(j_decompress_ptr cinfo)
+{
+  struct derived_tbl_cache *cache;
+
+  if (cinfo->master->derived_tbl_cache != NULL)
+    return;
+
+  cache = (struct derived_tbl_cache *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT,
+                                sizeof(struct derived_tbl_cache));
+  MEMZERO(cache, sizeof(struct derived_tbl_cache));
+  cinfo->master->derived_tbl_cache = cache;
+}
+
+
 /*
  * Compute the derived values for a Huffman table.
  * This routine also performs some validation checks on the table.
+ * If the derived table cache is enabled, then on return, *pdtbl points to
+ * the cached derived table for the specified table slot, which remains valid
+ * until the next call for the same slot.
  *
  * Note this is also used by jdphuff.c.
  */
@@ -143,6 +195,8 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
 {
   JHUFF_TBL *htbl;
   d_derived_tbl *dtbl;
+  struct derived_tbl_cache *cache = cinfo->master->derived_tbl_cache;
+  derived_tbl_cache_entry *entry = NULL;
   int p, i, l, si, numsymbols;
   int lookbits, ctr;
   char huffsize[257];
@@ -161,13 +215,26 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
   if (htbl == NULL)
     ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, tblno);
 
-  /* Allocate a workspace if we haven't already done so. */
-  if (*pdtbl == NULL)
-    *pdtbl = (d_derived_tbl *)
-      (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                                  sizeof(d_derived_tbl));
-  dtbl = *pdtbl;
-  dtbl->pub = htbl;             /* fill in back link */
+  if (cache != NULL) {
+    entry = isDC ? &cache->dc[tblno] : &cache->ac[tblno];
+    dtbl = *pdtbl = &entry->dtbl;
+    dtbl->pub = htbl;           /* fill in back link */
+
+    /* Reuse the cached derived table if the Huffman table hasn't changed. */
+    if (entry->valid &&
+        !MEMCMP(entry->bits, htbl->bits, sizeof(entry->bits)) &&
+        !MEMCMP(entry->huffval, htbl->huffval, sizeof(entry->huffval)))
+      return;
+    entry->valid = FALSE;
+  } else {
+    /* Allocate a workspace if we haven't already done so. */
+    if (*pdtbl == NULL)
+      *pdtbl = (d_derived_tbl *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
+                                    sizeof(d_derived_tbl));
+    dtbl = *pdtbl;
+    dtbl->pub = htbl;           /* fill in back link */
+  }
 
   /* Figure C.1: make table of Huffman code length for each symbol */
 
@@ -256,6 +323,12 @@ jpeg_make_d_derived_tbl(j_decompress_ptr cinfo, boolean isDC, int tblno,
         ERREXIT(cinfo, JERR_BAD_HUFF_TABLE);
     }
   }
+
+  if (entry != NULL) {
+    MEMCOPY(entry->bits, htbl->bits, sizeof(entry->bits));
+    MEMCOPY(entry->huffval, htbl->huffval, sizeof(entry->huffval));
+    entry->valid = TRUE;
+  }
 }
 
 
@@ -295,13 +295,6 @@ process_data_simple_main(j_decompress_ptr cinfo, JSAMPARRAY output_buf,
   my_main_ptr main_ptr = (my_main_ptr)cinfo->main;
   JDIMENSION rowgroups_avail;
 
-  /* Read input data if we haven't filled the main buffer yet */
-  if (!main_ptr->buffer_full) {
-    if (!(*cinfo->coef->decompress_data) (cinfo, main_ptr->buffer))
-      return;                   /* suspension forced, can do nothing more */
-    main_ptr->buffer_full = TRUE;       /* OK, we have an iMCU row to work with */
-  }
-
   /* There are always min_DCT_scaled_size row groups in an iMCU row. */
   rowgroups_avail = (JDIMENSION)cinfo->_min_DCT_scaled_size;
   /* Note: at the bottom of the image, we may pass extra garbage row groups
@@ -309,15 +302,36 @@ process_data_simple_main(j_decompress_ptr cinfo, JSAMPARRAY output_buf,
    * of image anyway (at row resolution), so no point in us doing it too.
    */
 
-  /* Feed the postprocessor */
-  (*cinfo->post->post_process_data) (cinfo, main_ptr->buffer,
-                                     &main_ptr->rowgroup_ctr, rowgroups_avail,
-                                     output_buf, out_row_ctr, out_rows_avail);
+  /* Keep going until the output buffer is full, so that a caller supplying a
+   * large buffer receives several iMCU rows per call.  (The caller never asks
+   * for rows beyond the bottom of the image.)
+   */
+  for (;;) {
+    /* Read input data if we haven't filled the main buffer yet */
+    if (!main_ptr->buffer_full) {
+      if (!(*cinfo->coef->decompress_data) (cinfo, main_ptr->buffer))
+        return;                 /* suspension forced, can do nothing more */
+      main_ptr->buffer_full = TRUE;     /* OK, we have an iMCU row */
+    }
 
-  /* Has postprocessor consumed all the data yet? If so, mark buffer empty */
-  if (main_ptr->rowgroup_ctr >= rowgroups_avail) {
-    main_ptr->buffer_full = FALSE;
-    main_ptr->rowgroup_ctr = 0;
+    /* Feed the postprocessor until it has consumed the iMCU row or filled the
+     * output buffer
+     */
+    do {
+      (*cinfo->post->post_process_data) (cinfo, main_ptr->buffer,
+                                         &main_ptr->rowgroup_ctr,
+                                         rowgroups_avail, output_buf,
+                                         out_row_ctr, out_rows_avail);
+    } while (main_ptr->rowgroup_ctr < rowgroups_avail &&
+             *out_row_ctr < out_rows_avail);
+
+    /* Has postprocessor consumed all the data yet? If so, mark buffer empty */
+    if (main_ptr->rowgroup_ctr >= rowgroups_avail) {
+      main_ptr->buffer_full = FALSE;
+      main_ptr->rowgroup_ctr = 0;
+    }
+    if (*out_row_ctr >= out_rows_avail)
+      return;
   }
 }
 
@@ -333,65 +347,81 @@ process_data_context_main(j_decompress_ptr cinfo, JSAMPARRAY output_buf,
 {
   my_main_ptr main_ptr = (my_main_ptr)cinfo->main;
 
-  /* Read input data if we haven't filled the main buffer yet */
-  if (!main_ptr->buffer_full) {
-    if (!(*cinfo->coef->decompress_data) (cinfo,
-                                          main_ptr->xbuffer[main_ptr->whichptr]))
-      return;                   /* suspension forced, can do nothing more */
-    main_ptr->buffer_full = TRUE;       /* OK, we have an iMCU row to work with */
-    main_ptr->iMCU_row_ctr++;   /* count rows received */
-  }
-
-  /* Postprocessor typically will not swallow all the input data it is handed
-   * in one call (due to filling the output buffer first).  Must be prepared
-   * to exit and restart.  This switch lets us keep track of how far we got.
-   * Note that each case falls through to the next on successful completion.
+  /* Keep going until the output buffer is full, so that a caller supplying a
+   * large buffer receives several iMCU rows per call.  (The caller never asks
+   * for rows beyond the bottom of the image.)
    */
-  switch (main_ptr->context_state) {
-  case CTX_POSTPONED_ROW:
-    /* Call postprocessor using previously set pointers for postponed row */
-    (*cinfo->post->post_process_data) (cinfo,
-                                       main_ptr->xbuffer[main_ptr->whichptr],
-                                       &main_ptr->rowgroup_ctr,
-                                       main_ptr->rowgroups_avail, output_buf,
-                                       out_row_ctr, out_rows_avail);
-    if (main_ptr->rowgroup_ctr < main_ptr->rowgroups_avail)
-      return;                   /* Need to suspend */
-    main_ptr->context_state = CTX_PREPARE_FOR_IMCU;
-    if (*out_row_ctr >= out_rows_avail)
-      return;                   /* Postprocessor exactly filled output buf */
-    /*FALLTHROUGH*/
-  case CTX_PREPARE_FOR_IMCU:
-    /* Prepare to process first M-1 row groups of this iMCU row */
-    main_ptr->rowgroup_ctr = 0;
-    main_ptr->rowgroups_avail = (JDIMENSION)(cinfo->_min_DCT_scaled_size - 1);
-    /* Check for bottom of image: if so, tweak pointers to "duplicate"
-     * the last sample row, and adjust rowgroups_avail to ignore padding rows.
+  for (;;) {
+    /* Read input data if we haven't filled the main buffer yet */
+    if (!main_ptr->buffer_full) {
+      if (!(*cinfo->coef->decompress_data)
+            (cinfo, main_ptr->xbuffer[main_ptr->whichptr]))
+        return;                 /* suspension forced, can do nothing more */
+      main_ptr->buffer_full = TRUE;     /* OK, we have an iMCU row */
+      main_ptr->iMCU_row_ctr++; /* count rows received */
+    }
+
+    /* Postprocessor typically will not swallow all the input data it is
+     * handed in one call (due to filling the output buffer first).  Must be
+     * prepared to exit and restart.  This switch lets us keep track of how far
+     * we got.  Note that each case falls through to the next on successful
+     * completion.
      */
-    if (main_ptr->iMCU_row_ctr == cinfo->total_iMCU_rows)
-      set_bottom_pointers(cinfo);
-    main_ptr->context_state = CTX_PROCESS_IMCU;
-    /*FALLTHROUGH*/
-  case CTX_PROCESS_IMCU:
-    /* Call postprocessor using previously set pointers */
-    (*cinfo->post->post_process_data) (cinfo,
-                                       main_ptr->xbuffer[main_ptr->whichptr],
-                                       &main_ptr->rowgroup_ctr,
-                                       main_ptr->rowgroups_avail, output_buf,
-                                       out_row_ctr, out_rows_avail);
-    if (main_ptr->rowgroup_ctr < main_ptr->rowgroups_avail)
-      return;                   /* Need to suspend */
-    /* After the first iMCU, change wraparound pointers to normal state */
-    if (main_ptr->iMCU_row_ctr == 1)
-      set_wraparound_pointers(cinfo);
-    /* Prepare to load new iMCU row using other xbuffer list */
-    main_ptr->whichptr ^= 1;    /* 0=>1 or 1=>0 */
-    main_ptr->buffer_full = FALSE;
-    /* Still need to process last row group of this iMCU row, */
-    /* which is saved at index M+1 of the other xbuffer */
-    main_ptr->rowgroup_ctr = (JDIMENSION)(cinfo->_min_DCT_scaled_size + 1);
-    main_ptr->rowgroups_avail = (JDIMENSION)(cinfo->_min_DCT_scaled_size + 2);
-    main_ptr->context_state = CTX_POSTPONED_ROW;
+    switch (main_ptr->context_state) {
+    case CTX_POSTPONED_ROW:
+      /* Call postprocessor using previously set pointers for postponed row */
+      do {
+        (*cinfo->post->post_process_data)
+          (cinfo, main_ptr->xbuffer[main_ptr->whichptr],
+           &main_ptr->rowgroup_ctr, main_ptr->rowgroups_avail, output_buf,
+           out_row_ctr, out_rows_avail);
+      } while (main_ptr->rowgroup_ctr < main_ptr->rowgroups_avail &&
+               *out_row_ctr < out_rows_avail);
+      if (main_ptr->rowgroup_ctr < main_ptr->rowgroups_avail)
+        return;                 /* Need to suspend */
+      main_ptr->context_state = CTX_PREPARE_FOR_IMCU;
+      if (*out_row_ctr >= out_rows_avail)
+        return;                 /* Postprocessor exactly filled output buf */
+      /*FALLTHROUGH*/
+    case CTX_PREPARE_FOR_IMCU:
+      /* Prepare to process first M-1 row groups of this iMCU row */
+      main_ptr->rowgroup_ctr = 0;
+      main_ptr->rowgroups_avail =
+        (JDIMENSION)(cinfo->_min_DCT_scaled_size - 1);
+      /* Check for bottom of image: if so, tweak pointers to "duplicate"
+       * the last sample row, and adjust rowgroups_avail to ignore padding
+       * rows.
+       */
+      if (main_ptr->iMCU_row_ctr == cinfo->total_iMCU_rows)
+        set_bottom_pointers(cinfo);
+      main_ptr->context_state = CTX_PROCESS_IMCU;
+      /*FALLTHROUGH*/
+    case CTX_PROCESS_IMCU:
+      /* Call postprocessor using previously set pointers */
+      do {
+        (*cinfo->post->post_process_data)
+          (cinfo, main_ptr->xbuffer[main_ptr->whichptr],
+           &main_ptr->rowgroup_ctr, main_ptr->rowgroups_avail, output_buf,
+           out_row_ctr, out_rows_avail);
+      } while (main_ptr->rowgroup_ctr < main_ptr->rowgroups_avail &&
+               *out_row_ctr < out_rows_avail);
+      if (main_ptr->rowgroup_ctr < main_ptr->rowgroups_avail)
+        return;                 /* Need to suspend */
+      /* After the first iMCU, change wraparound pointers to normal state */
+      if (main_ptr->iMCU_row_ctr == 1)
+        set_wraparound_pointers(cinfo);
+      /* Prepare to load new iMCU row using other xbuffer list */
+      main_ptr->whichptr ^= 1;  /* 0=>1 or 1=>0 */
+      main_ptr->buffer_full = FALSE;
+      /* Still need to process last row group of this iMCU row, */
+      /* which is saved at index M+1 of the other xbuffer */
+      main_ptr->rowgroup_ctr = (JDIMENSION)(cinfo->_min_DCT_scaled_size + 1);
+      main_ptr->rowgroups_avail =
+        (JDIMENSION)(cinfo->_min_DCT_scaled_size + 2);
+      main_ptr->context_state = CTX_POSTPONED_ROW;
+    }
+    if (*out_row_ctr >= out_rows_avail)
+      return;
   }
 }
 
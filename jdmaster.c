@@ -402,34 +402,60 @@ jpeg_calc_output_dimensions(j_decompress_ptr cinfo)
  * We can save some space by overlapping the start of the post-IDCT table
  * with the simpler range limiting table.  The post-IDCT table begins at
  * sample_range_limit + CENTERJSAMPLE.
+ *
+ * Since its contents are fixed, the table is a static constant that all
+ * decompressor instances share.  It consists of blocks of CENTERJSAMPLE
+ * entries:
+ *   2 blocks of 0 (limit[x] = 0 for x < 0),
+ *   0,1,...,MAXJSAMPLE (limit[x] = x),
+ *   3 blocks of MAXJSAMPLE,
+ *   3 blocks of 0,
+ *   0,1,...,CENTERJSAMPLE-1
  */
 
+#define RL_SEQ4(i)    (i), (i) + 1, (i) + 2, (i) + 3
+#define RL_SEQ16(i)   RL_SEQ4(i), RL_SEQ4((i) + 4), RL_SEQ4((i) + 8), \
+                      RL_SEQ4((i) + 12)
+#define RL_SEQ64(i)   RL_SEQ16(i), RL_SEQ16((i) + 16), RL_SEQ16((i) + 32), \
+                      RL_SEQ16((i) + 48)
+#define RL_SEQ128(i)  RL_SEQ64(i), RL_SEQ64((i) + 64)
+
+#define RL_REP4(v)    v, v, v, v
+#define RL_REP16(v)   RL_REP4(v), RL_REP4(v), RL_REP4(v), RL_REP4(v)
+#define RL_REP64(v)   RL_REP16(v), RL_REP16(v), RL_REP16(v), RL_REP16(v)
+#define RL_REP128(v)  RL_REP64(v), RL_REP64(v)
+
+#if BITS_IN_JSAMPLE == 8
+#define RL_SEQ_BLOCK(i)  RL_SEQ128(i)
+#define RL_REP_BLOCK(v)  RL_REP128(v)
+#else
+#define RL_SEQ512(i)   RL_SEQ128(i), RL_SEQ128((i) + 128), \
+                       RL_SEQ128((i) + 256), RL_SEQ128((i) + 384)
+#define RL_SEQ2048(i)  RL_SEQ512(i), RL_SEQ512((i) + 512), \
+                       RL_SEQ512((i) + 1024), RL_SEQ512((i) + 1536)
+#define RL_REP512(v)   RL_REP128(v), RL_REP128(v), RL_REP128(v), RL_REP128(v)
+#define RL_REP2048(v)  RL_REP512(v), RL_REP512(v), RL_REP512(v), RL_REP512(v)
+#define RL_SEQ_BLOCK(i)  RL_SEQ2048(i)
+#define RL_REP_BLOCK(v)  RL_REP2048(v)
+#endif
+
+static const JSAMPLE range_limit_table[5 * (MAXJSAMPLE + 1) + CENTERJSAMPLE] = {
+  RL_REP_BLOCK(0), RL_REP_BLOCK(0),
+  RL_SEQ_BLOCK(0), RL_SEQ_BLOCK(CENTERJSAMPLE),
+  RL_REP_BLOCK(MAXJSAMPLE), RL_REP_BLOCK(MAXJSAMPLE),
+  RL_REP_BLOCK(MAXJSAMPLE),
+  RL_REP_BLOCK(0), RL_REP_BLOCK(0), RL_REP_BLOCK(0),
+  RL_SEQ_BLOCK(0)
+};
+
 LOCAL(void)
 prepare_range_limit_table(j_decompress_ptr cinfo)
-/* Allocate and fill in the sample_range_limit table */
+/* Set up the sample_range_limit table */
 {
-  JSAMPLE *table;
-  int i;
-
-  table = (JSAMPLE *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
-                (5 * (MAXJSAMPLE + 1) + CENTERJSAMPLE) * sizeof(JSAMPLE));
-  table += (MAXJSAMPLE + 1);    /* allow negative subscripts of simple table */
-  cinfo->sample_range_limit = table;
-  /* First segment of "simple" table: limit[x] = 0 for x < 0 */
-  MEMZERO(table - (MAXJSAMPLE + 1), (MAXJSAMPLE + 1) * sizeof(JSAMPLE));
-  /* Main part of "simple" table: limit[x] = x */
-  for (i = 0; i <= MAXJSAMPLE; i++)
-    table[i] = (JSAMPLE)i;
-  table += CENTERJSAMPLE;       /* Point to where post-IDCT table starts */
-  /* End of simple table, rest of first half of post-IDCT table */
-  for (i = CENTERJSAMPLE; i < 2 * (MAXJSAMPLE + 1); i++)
-    table[i] = MAXJSAMPLE;
-  /* Second half of post-IDCT table */
-  MEMZERO(table + (2 * (MAXJSAMPLE + 1)),
-          (2 * (MAXJSAMPLE + 1) - CENTERJSAMPLE) * sizeof(JSAMPLE));
-  MEMCOPY(table + (4 * (MAXJSAMPLE + 1) - CENTERJSAMPLE),
-          cinfo->sample_range_limit, CENTERJSAMPLE * sizeof(JSAMPLE));
+  /* allow negative subscripts of simple table.  The table is read-only, but
+   * sample_range_limit is not declared const, for backward compatibility.
+   */
+  cinfo->sample_range_limit = (JSAMPLE *)&range_limit_table[MAXJSAMPLE + 1];
 }
 
 
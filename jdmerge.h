@@ -25,10 +25,10 @@ typedef struct {
                     JDIMENSION in_row_group_ctr, JSAMPARRAY output_buf);
 
   /* Private state for YCC->RGB conversion */
-  int *Cr_r_tab;                /* => table for Cr to R conversion */
-  int *Cb_b_tab;                /* => table for Cb to B conversion */
-  JLONG *Cr_g_tab;              /* => table for Cr to G conversion */
-  JLONG *Cb_g_tab;              /* => table for Cb to G conversion */
+  const int *Cr_r_tab;          /* => table for Cr to R conversion */
+  const int *Cb_b_tab;          /* => table for Cb to B conversion */
+  const JLONG *Cr_g_tab;        /* => table for Cr to G conversion */
+  const JLONG *Cb_g_tab;        /* => table for Cb to G conversion */
 
   /* For 2:1 vertical sampling, we produce two output rows at a time.
    * We need a "spare" row buffer to hold the second output row if the
@@ -27,10 +27,10 @@ h2v1_merged_upsample_565_internal(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  int *Crrtab = upsample->Cr_r_tab;
-  int *Cbbtab = upsample->Cb_b_tab;
-  JLONG *Crgtab = upsample->Cr_g_tab;
-  JLONG *Cbgtab = upsample->Cb_g_tab;
+  const int *Crrtab = upsample->Cr_r_tab;
+  const int *Cbbtab = upsample->Cb_b_tab;
+  const JLONG *Crgtab = upsample->Cr_g_tab;
+  const JLONG *Cbgtab = upsample->Cb_g_tab;
   unsigned int r, g, b;
   JLONG rgb;
   SHIFT_TEMPS
@@ -98,10 +98,10 @@ h2v1_merged_upsample_565D_internal(j_decompress_ptr cinfo,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  int *Crrtab = upsample->Cr_r_tab;
-  int *Cbbtab = upsample->Cb_b_tab;
-  JLONG *Crgtab = upsample->Cr_g_tab;
-  JLONG *Cbgtab = upsample->Cb_g_tab;
+  const int *Crrtab = upsample->Cr_r_tab;
+  const int *Cbbtab = upsample->Cb_b_tab;
+  const JLONG *Crgtab = upsample->Cr_g_tab;
+  const JLONG *Cbgtab = upsample->Cb_g_tab;
   JLONG d0 = dither_matrix[cinfo->output_scanline & DITHER_MASK];
   unsigned int r, g, b;
   JLONG rgb;
@@ -171,10 +171,10 @@ h2v2_merged_upsample_565_internal(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  int *Crrtab = upsample->Cr_r_tab;
-  int *Cbbtab = upsample->Cb_b_tab;
-  JLONG *Crgtab = upsample->Cr_g_tab;
-  JLONG *Cbgtab = upsample->Cb_g_tab;
+  const int *Crrtab = upsample->Cr_r_tab;
+  const int *Cbbtab = upsample->Cb_b_tab;
+  const JLONG *Crgtab = upsample->Cr_g_tab;
+  const JLONG *Cbgtab = upsample->Cb_g_tab;
   unsigned int r, g, b;
   JLONG rgb;
   SHIFT_TEMPS
@@ -267,10 +267,10 @@ h2v2_merged_upsample_565D_internal(j_decompress_ptr cinfo,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  int *Crrtab = upsample->Cr_r_tab;
-  int *Cbbtab = upsample->Cb_b_tab;
-  JLONG *Crgtab = upsample->Cr_g_tab;
-  JLONG *Cbgtab = upsample->Cb_g_tab;
+  const int *Crrtab = upsample->Cr_r_tab;
+  const int *Cbbtab = upsample->Cb_b_tab;
+  const JLONG *Crgtab = upsample->Cr_g_tab;
+  const JLONG *Cbgtab = upsample->Cb_g_tab;
   JLONG d0 = dither_matrix[cinfo->output_scanline & DITHER_MASK];
   JLONG d1 = dither_matrix[(cinfo->output_scanline + 1) & DITHER_MASK];
   unsigned int r, g, b;
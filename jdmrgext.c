@@ -33,10 +33,10 @@ h2v1_merged_upsample_internal(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  int *Crrtab = upsample->Cr_r_tab;
-  int *Cbbtab = upsample->Cb_b_tab;
-  JLONG *Crgtab = upsample->Cr_g_tab;
-  JLONG *Cbgtab = upsample->Cb_g_tab;
+  const int *Crrtab = upsample->Cr_r_tab;
+  const int *Cbbtab = upsample->Cb_b_tab;
+  const JLONG *Crgtab = upsample->Cr_g_tab;
+  const JLONG *Cbgtab = upsample->Cb_g_tab;
   SHIFT_TEMPS
 
   inptr0 = input_buf[0][in_row_group_ctr];
@@ -105,10 +105,10 @@ h2v2_merged_upsample_internal(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
   JDIMENSION col;
   /* copy these pointers into registers if possible */
   register JSAMPLE *range_limit = cinfo->sample_range_limit;
-  int *Crrtab = upsample->Cr_r_tab;
-  int *Cbbtab = upsample->Cb_b_tab;
-  JLONG *Crgtab = upsample->Cr_g_tab;
-  JLONG *Cbgtab = upsample->Cb_g_tab;
+  const int *Crrtab = upsample->Cr_r_tab;
+  const int *Cbbtab = upsample->Cb_b_tab;
+  const JLONG *Crgtab = upsample->Cr_g_tab;
+  const JLONG *Cbgtab = upsample->Cb_g_tab;
   SHIFT_TEMPS
 
   inptr00 = input_buf[0][in_row_group_ctr * 2];
@@ -53,7 +53,9 @@ typedef struct {
   /* These fields are NOT loaded into local working state. */
   unsigned int restarts_to_go;  /* MCUs left in this restart interval */
 
-  /* Pointers to derived tables (these workspaces have image lifespan) */
+  /* Pointers to derived tables (these workspaces have image lifespan, unless
+   * the derived table cache is enabled)
+   */
   d_derived_tbl *derived_tbls[NUM_HUFF_TBLS];
 
   d_derived_tbl *ac_derived_tbl; /* active table during an AC scan */
@@ -496,6 +498,33 @@ decode_mcu_DC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
  * MCU decoding for AC successive approximation refinement scan.
  */
 
+/* Append correction bits to the num_nz already-nonzero coefficients pointed
+ * to by nz_coefs[].  A correction bit is 1 if the absolute value of the
+ * coefficient must be increased.  The bits are fetched up to 16 at a time,
+ * and they are applied without branching on the bit or the sign of the
+ * coefficient.  If we are forced to suspend partway through, any bits that
+ * were already applied are detected on the next attempt by the (coef & p1)
+ * test, just as in the bit-at-a-time version of this code.
+ */
+
+#define APPLY_CORRECTION_BITS(nz_coefs, num_nz, action) { \
+  int nzi, nzj, nbits, bits, sign, upd; \
+  JCOEF coef; \
+  for (nzi = 0; nzi < (num_nz); nzi += nbits) { \
+    nbits = MIN((num_nz) - nzi, 16); \
+    CHECK_BIT_BUFFER(br_state, nbits, action); \
+    bits = GET_BITS(nbits); \
+    for (nzj = 0; nzj < nbits; nzj++) { \
+      coef = *(nz_coefs)[nzi + nzj]; \
+      /* upd = -1 if the bit is set and we haven't already applied it */ \
+      upd = -((bits >> (nbits - 1 - nzj)) & ((coef & p1) == 0)); \
+      /* add p1 to positive coefficients and m1 (-p1) to negative ones */ \
+      sign = -(coef < 0); \
+      *(nz_coefs)[nzi + nzj] = (JCOEF)(coef + (((p1 ^ sign) - sign) & upd)); \
+    } \
+  } \
+}
+
 METHODDEF(boolean)
 decode_mcu_AC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 {
@@ -509,8 +538,9 @@ decode_mcu_AC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   JCOEFPTR thiscoef;
   BITREAD_STATE_VARS;
   d_derived_tbl *tbl;
-  int num_newnz;
+  int num_newnz, num_nz;
   int newnz_pos[DCTSIZE2];
+  JCOEFPTR nz_coefs[DCTSIZE2];
 
   /* Process restart marker if needed; may have to suspend */
   if (cinfo->restart_interval) {
@@ -568,27 +598,20 @@ decode_mcu_AC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
           /* note s = 0 for processing ZRL */
         }
         /* Advance over already-nonzero coefs and r still-zero coefs,
-         * appending correction bits to the nonzeroes.  A correction bit is 1
-         * if the absolute value of the coefficient must be increased.
+         * appending correction bits to the nonzeroes.
          */
+        num_nz = 0;
         do {
           thiscoef = *block + jpeg_natural_order[k];
           if (*thiscoef != 0) {
-            CHECK_BIT_BUFFER(br_state, 1, goto undoit);
-            if (GET_BITS(1)) {
-              if ((*thiscoef & p1) == 0) { /* do nothing if already set it */
-                if (*thiscoef >= 0)
-                  *thiscoef += p1;
-                else
-                  *thiscoef += m1;
-              }
-            }
+            nz_coefs[num_nz++] = thiscoef;
           } else {
             if (--r < 0)
               break;            /* reached target zero coefficient */
           }
           k++;
         } while (k <= Se);
+        APPLY_CORRECTION_BITS(nz_coefs, num_nz, goto undoit);
         if (s) {
           int pos = jpeg_natural_order[k];
           /* Output newly nonzero coefficient */
@@ -602,23 +625,15 @@ decode_mcu_AC_refine(j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     if (EOBRUN > 0) {
       /* Scan any remaining coefficient positions after the end-of-band
        * (the last newly nonzero coefficient, if any).  Append a correction
-       * bit to each already-nonzero coefficient.  A correction bit is 1
-       * if the absolute value of the coefficient must be increased.
+       * bit to each already-nonzero coefficient.
        */
+      num_nz = 0;
       for (; k <= Se; k++) {
         thiscoef = *block + jpeg_natural_order[k];
-        if (*thiscoef != 0) {
-          CHECK_BIT_BUFFER(br_state, 1, goto undoit);
-          if (GET_BITS(1)) {
-            if ((*thiscoef & p1) == 0) { /* do nothing if already changed it */
-              if (*thiscoef >= 0)
-                *thiscoef += p1;
-              else
-                *thiscoef += m1;
-            }
-          }
-        }
+        if (*thiscoef != 0)
+          nz_coefs[num_nz++] = thiscoef;
       }
+      APPLY_CORRECTION_BITS(nz_coefs, num_nz, goto undoit);
       /* Count one block completed in EOB run */
       EOBRUN--;
     }
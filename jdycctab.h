@@ -0,0 +1,30 @@
+/*
+ * jdycctab.h
+ *
+ * This file was part of the Independent JPEG Group's software:
+ * Copyright (C) 1991-1997, Thomas G. Lane.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2021, D. R. Commander.
+ * For conditions of distribution and use, see the accompanying README.ijg
+ * file.
+ *
+ * This file declares the lookup tables used for YCbCr->RGB conversion.  The
+ * tables depend only on compile-time constants, so they are generated by the
+ * preprocessor and shared read-only by all decompressor instances, rather
+ * than being computed and stored separately by each instance.  They are
+ * defined in jdcolor.c and also used by jdmerge.c.
+ */
+
+#ifndef JDYCCTAB_H
+#define JDYCCTAB_H
+
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+
+
+extern const int jpeg_ycc_Cr_r_tab[];   /* Cr=>R table */
+extern const int jpeg_ycc_Cb_b_tab[];   /* Cb=>B table */
+extern const JLONG jpeg_ycc_Cr_g_tab[]; /* Cr=>G table */
+extern const JLONG jpeg_ycc_Cb_g_tab[]; /* Cb=>G table */
+
+#endif /* JDYCCTAB_H */
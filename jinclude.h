@@ -49,7 +49,8 @@
 #include <stdio.h>
 
 /*
- * We need memory copying and zeroing functions, plus strncpy().
+ * We need memory copying, zeroing, and comparison functions, plus strncpy().
+ * (MEMCMP() is used only to test for equality.)
  * ANSI and System V implementations declare these in <string.h>.
  * BSD doesn't have the mem() functions, but it does have bcopy()/bzero().
  * Some systems may declare memset and memcpy in <memory.h>.
@@ -65,6 +66,8 @@
   bzero((void *)(target), (size_t)(size))
 #define MEMCOPY(dest, src, size) \
   bcopy((const void *)(src), (void *)(dest), (size_t)(size))
+#define MEMCMP(ptr1, ptr2, size) \
+  bcmp((const void *)(ptr1), (const void *)(ptr2), (size_t)(size))
 
 #else /* not BSD, assume ANSI/SysV string lib */
 
@@ -73,6 +76,8 @@
   memset((void *)(target), 0, (size_t)(size))
 #define MEMCOPY(dest, src, size) \
   memcpy((void *)(dest), (const void *)(src), (size_t)(size))
+#define MEMCMP(ptr1, ptr2, size) \
+  memcmp((const void *)(ptr1), (const void *)(ptr2), (size_t)(size))
 
 #endif
 
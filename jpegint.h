@@ -161,6 +161,11 @@ struct jpeg_decomp_master {
 
   /* Last iMCU row that was successfully decoded */
   JDIMENSION last_good_iMCU_row;
+
+  /* Derived Huffman tables, retained across scans and images if enabled by
+   * jinit_d_derived_tbl_cache() (jdhuff.c)
+   */
+  struct derived_tbl_cache *derived_tbl_cache;
 };
 
 /* Input control module */
@@ -317,6 +322,7 @@ EXTERN(void) jinit_c_coef_controller(j_compress_ptr cinfo,
 EXTERN(void) jinit_color_converter(j_compress_ptr cinfo);
 EXTERN(void) jinit_downsampler(j_compress_ptr cinfo);
 EXTERN(void) jinit_forward_dct(j_compress_ptr cinfo);
+EXTERN(void) jinit_fdct_block_cache(j_compress_ptr cinfo, void **cache_ptr);
 EXTERN(void) jinit_huff_encoder(j_compress_ptr cinfo);
 EXTERN(void) jinit_phuff_encoder(j_compress_ptr cinfo);
 EXTERN(void) jinit_arith_encoder(j_compress_ptr cinfo);
@@ -332,6 +338,7 @@ EXTERN(void) jinit_d_post_controller(j_decompress_ptr cinfo,
 EXTERN(void) jinit_input_controller(j_decompress_ptr cinfo);
 EXTERN(void) jinit_marker_reader(j_decompress_ptr cinfo);
 EXTERN(void) jinit_huff_decoder(j_decompress_ptr cinfo);
+EXTERN(void) jinit_d_derived_tbl_cache(j_decompress_ptr cinfo);
 EXTERN(void) jinit_phuff_decoder(j_decompress_ptr cinfo);
 EXTERN(void) jinit_arith_decoder(j_decompress_ptr cinfo);
 EXTERN(void) jinit_inverse_dct(j_decompress_ptr cinfo);
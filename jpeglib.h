@@ -246,7 +246,9 @@ typedef enum {
 typedef enum {
   JDCT_ISLOW,             /* accurate integer method */
   JDCT_IFAST,             /* less accurate integer method [legacy feature] */
-  JDCT_FLOAT              /* floating-point method [legacy feature] */
+  JDCT_FLOAT,             /* floating-point method [legacy feature] */
+  JDCT_AUTO               /* choose ISLOW or IFAST for each component based
+                             on its quantization table (decompression only) */
 } J_DCT_METHOD;
 
 #ifndef JDCT_DEFAULT            /* may be overridden in jconfig.h */
@@ -655,7 +657,7 @@ struct jpeg_decompress_struct {
    * v_samp_factor*DCT_[v_]scaled_size sample rows of a component per iMCU row.
    */
 
-  JSAMPLE *sample_range_limit;  /* table for fast range-limiting */
+  JSAMPLE *sample_range_limit;  /* table for fast range-limiting (read-only) */
 
   /*
    * These fields are valid during any one scan.
@@ -565,6 +565,45 @@ quantize_ord_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 }
 
 
+METHODDEF(void)
+quantize1_ord_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
+                     JSAMPARRAY output_buf, int num_rows)
+/* Fast path for out_color_components==1, with ordered dithering */
+{
+  my_cquantize_ptr cquantize = (my_cquantize_ptr)cinfo->cquantize;
+  register JSAMPROW input_ptr;
+  register JSAMPROW output_ptr;
+  JSAMPROW colorindex0 = cquantize->colorindex[0];
+  int *dither0;                 /* points to active row of dither matrix */
+  int row_index;                /* current index into dither matrix */
+  int row, k;
+  JDIMENSION col;
+  JDIMENSION width = cinfo->output_width;
+
+  for (row = 0; row < num_rows; row++) {
+    row_index = cquantize->row_index;
+    input_ptr = input_buf[row];
+    output_ptr = output_buf[row];
+    dither0 = cquantize->odither[0][row_index];
+
+    /* Process the row in groups of ODITHER_SIZE pixels, so that the column
+     * index into the dither matrix is a constant for each pixel in a group.
+     */
+    for (col = width; col >= ODITHER_SIZE; col -= ODITHER_SIZE) {
+      for (k = 0; k < ODITHER_SIZE; k++)
+        output_ptr[k] = colorindex0[input_ptr[k] + dither0[k]];
+      input_ptr += ODITHER_SIZE;
+      output_ptr += ODITHER_SIZE;
+    }
+    for (k = 0; k < (int)col; k++)
+      output_ptr[k] = colorindex0[input_ptr[k] + dither0[k]];
+
+    row_index = (row_index + 1) & ODITHER_MASK;
+    cquantize->row_index = row_index;
+  }
+}
+
+
 METHODDEF(void)
 quantize3_ord_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
                      JSAMPARRAY output_buf, int num_rows)
@@ -580,8 +619,8 @@ quantize3_ord_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
   int *dither0;                 /* points to active row of dither matrix */
   int *dither1;
   int *dither2;
-  int row_index, col_index;     /* current indexes into dither matrix */
-  int row;
+  int row_index;                /* current index into dither matrix */
+  int row, k;
   JDIMENSION col;
   JDIMENSION width = cinfo->output_width;
 
@@ -592,15 +631,27 @@ quantize3_ord_dither(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
     dither0 = cquantize->odither[0][row_index];
     dither1 = cquantize->odither[1][row_index];
     dither2 = cquantize->odither[2][row_index];
-    col_index = 0;
 
-    for (col = width; col > 0; col--) {
-      pixcode  = colorindex0[(*input_ptr++) + dither0[col_index]];
-      pixcode += colorindex1[(*input_ptr++) + dither1[col_index]];
-      pixcode += colorindex2[(*input_ptr++) + dither2[col_index]];
-      *output_ptr++ = (JSAMPLE)pixcode;
-      col_index = (col_index + 1) & ODITHER_MASK;
+    /* Process the row in groups of ODITHER_SIZE pixels (see
+     * quantize1_ord_dither().)
+     */
+    for (col = width; col >= ODITHER_SIZE; col -= ODITHER_SIZE) {
+      for (k = 0; k < ODITHER_SIZE; k++) {
+        pixcode  = colorindex0[input_ptr[k * 3 + 0] + dither0[k]];
+        pixcode += colorindex1[input_ptr[k * 3 + 1] + dither1[k]];
+        pixcode += colorindex2[input_ptr[k * 3 + 2] + dither2[k]];
+        output_ptr[k] = (JSAMPLE)pixcode;
+      }
+      input_ptr += ODITHER_SIZE * 3;
+      output_ptr += ODITHER_SIZE;
     }
+    for (k = 0; k < (int)col; k++) {
+      pixcode  = colorindex0[input_ptr[k * 3 + 0] + dither0[k]];
+      pixcode += colorindex1[input_ptr[k * 3 + 1] + dither1[k]];
+      pixcode += colorindex2[input_ptr[k * 3 + 2] + dither2[k]];
+      output_ptr[k] = (JSAMPLE)pixcode;
+    }
+
     row_index = (row_index + 1) & ODITHER_MASK;
     cquantize->row_index = row_index;
   }
@@ -759,6 +810,8 @@ start_pass_1_quant(j_decompress_ptr cinfo, boolean is_pre_scan)
   case JDITHER_ORDERED:
     if (cinfo->out_color_components == 3)
       cquantize->pub.color_quantize = quantize3_ord_dither;
+    else if (cinfo->out_color_components == 1)
+      cquantize->pub.color_quantize = quantize1_ord_dither;
     else
       cquantize->pub.color_quantize = quantize_ord_dither;
     cquantize->row_index = 0;   /* initialize state for ordered dither */
@@ -125,6 +125,11 @@ static const int c_scales[3] = { R_SCALE, G_SCALE, B_SCALE };
 #define C1_SHIFT  (BITS_IN_JSAMPLE - HIST_C1_BITS)
 #define C2_SHIFT  (BITS_IN_JSAMPLE - HIST_C2_BITS)
 
+/* Number of adjacent pixel pairs that prescan_quantize() samples in each row
+ * to decide whether to count runs of pixels
+ */
+#define RUN_SAMPLES  32
+
 
 typedef UINT16 histcell;        /* histogram cell; prefer an unsigned type */
 
@@ -205,23 +210,69 @@ prescan_quantize(j_decompress_ptr cinfo, JSAMPARRAY input_buf,
 {
   my_cquantize_ptr cquantize = (my_cquantize_ptr)cinfo->cquantize;
   register JSAMPROW ptr;
-  register histptr histp;
+  register histptr histp, prevp;
   register hist3d histogram = cquantize->histogram;
-  int row;
-  JDIMENSION col;
+  JLONG runlen;
+  int row, samples, repeats;
+  JDIMENSION col, step;
   JDIMENSION width = cinfo->output_width;
 
+  step = MAX(width / RUN_SAMPLES, 1);
+
   for (row = 0; row < num_rows; row++) {
     ptr = input_buf[row];
-    for (col = width; col > 0; col--) {
-      /* get pixel value and index into the histogram */
-      histp = &histogram[ptr[0] >> C0_SHIFT]
-                        [ptr[1] >> C1_SHIFT]
-                        [ptr[2] >> C2_SHIFT];
-      /* increment, check for overflow and undo increment if so. */
-      if (++(*histp) <= 0)
-        (*histp)--;
-      ptr += 3;
+
+    /* Synthetic images tend to have long runs of pixels that fall into the
+     * same histogram cell.  Incrementing the same cell for each pixel in such
+     * a run is slow, since each increment must wait for the previous one.
+     * Thus, if a sample of adjacent pixel pairs in this row indicates that
+     * the row consists mainly of such runs, then we count each run in a
+     * register and add it to the cell when the run ends.  (For photographic
+     * images, the run boundaries are too unpredictable for this to pay off.)
+     */
+    samples = repeats = 0;
+    for (col = 1; col < width; col += step) {
+      JSAMPROW p0 = ptr + (col - 1) * 3, p1 = p0 + 3;
+
+      samples++;
+      repeats += (((p0[0] ^ p1[0]) >> C0_SHIFT) |
+                  ((p0[1] ^ p1[1]) >> C1_SHIFT) |
+                  ((p0[2] ^ p1[2]) >> C2_SHIFT)) == 0;
+    }
+
+    if (samples > 0 && repeats * 8 >= samples * 7) {
+      prevp = NULL;
+      runlen = 0;
+      for (col = width; col > 0; col--) {
+        histp = &histogram[ptr[0] >> C0_SHIFT]
+                          [ptr[1] >> C1_SHIFT]
+                          [ptr[2] >> C2_SHIFT];
+        ptr += 3;
+        if (histp == prevp) {
+          runlen++;
+          continue;
+        }
+        if (prevp != NULL) {
+          /* add the run, clamping the cell to its maximum value. */
+          runlen += *prevp;
+          *prevp = (histcell)MIN(runlen, 0xFFFF);
+        }
+        prevp = histp;
+        runlen = 1;
+      }
+      runlen += *prevp;
+      *prevp = (histcell)MIN(runlen, 0xFFFF);
+    } else {
+      for (col = width; col > 0; col--) {
+        /* get pixel value and index into the histogram */
+        histp = &histogram[ptr[0] >> C0_SHIFT]
+                          [ptr[1] >> C1_SHIFT]
+                          [ptr[2] >> C2_SHIFT];
+        /* increment, check for overflow and undo increment if so. */
+        if (++(*histp) <= 0)
+          (*histp)--;
+        ptr += 3;
+      }
     }
   }
 }
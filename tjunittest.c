@@ -41,6 +41,7 @@
 #ifdef _WIN32
 #include <time.h>
 #define random()  rand()
+#define setenv(envvar, value, dummy)  _putenv_s(envvar, value)
 #else
 #include <unistd.h>
 #endif
@@ -671,6 +672,1039 @@ bailout:
 }
 
 
+/* Copy the quantization table (in zigzag order) used by the given component
+   of a JPEG image into table[].  Returns -1 if the table cannot be found. */
+static int getQuantTable(const unsigned char *jpegBuf, unsigned long jpegSize,
+                         int comp, unsigned char table[64])
+{
+  const unsigned char *tables[4] = { NULL, NULL, NULL, NULL };
+  unsigned long pos = 2, len, i;
+  int tq = -1;
+
+  while (pos + 4 <= jpegSize && jpegBuf[pos] == 0xFF &&
+         jpegBuf[pos + 1] != 0xDA) {
+    len = 2 + ((jpegBuf[pos + 2] << 8) | jpegBuf[pos + 3]);
+    if (pos + len > jpegSize) break;
+    if (jpegBuf[pos + 1] == 0xDB) {
+      for (i = pos + 4; i + 1 + 64 <= pos + len; i += 1 + 64)
+        tables[jpegBuf[i] & 3] = &jpegBuf[i + 1];
+    } else if (jpegBuf[pos + 1] >= 0xC0 && jpegBuf[pos + 1] <= 0xC2 &&
+               comp < jpegBuf[pos + 9])
+      tq = jpegBuf[pos + 12 + 3 * comp] & 3;
+    pos += len;
+  }
+  if (tq < 0 || !tables[tq]) return -1;
+  memcpy(table, tables[tq], 64);
+  return 0;
+}
+
+
+static void transcodeTest(void)
+{
+  tjhandle chandle = NULL, xhandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *dstJpegBuf = NULL,
+    *dstBuf = NULL, *qtJpegBuf = NULL;
+  unsigned long jpegSize = 0, dstJpegSize = 0, qtJpegSize = 0;
+  int w = 48, h = 48, i;
+  static const struct {
+    tjscalingfactor sf;
+    int subsamp, jpegQual;
+  } tests[] = {
+    { { 1, 1 }, -1, -1 },
+    { { 1, 2 }, TJSAMP_444, 100 },
+    { { 1, 2 }, TJSAMP_GRAY, 100 },
+    { { 1, 4 }, TJSAMP_GRAY, -1 }
+  };
+
+  if ((chandle = tjInitCompress()) == NULL ||
+      (xhandle = tjInitTransform()) == NULL ||
+      (dhandle = tjInitDecompress()) == NULL)
+    THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL ||
+      (dstBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  initBuf(srcBuf, w, h, TJPF_RGB, 0);
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     TJSAMP_444, 100, 0));
+
+  for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+    int scaledWidth = TJSCALED(w, tests[i].sf);
+    int scaledHeight = TJSCALED(h, tests[i].sf);
+    int subsamp = tests[i].subsamp < 0 ? TJSAMP_444 : tests[i].subsamp;
+    int _hdrw = 0, _hdrh = 0, _hdrsubsamp = -1;
+
+    printf("JPEG -> JPEG %s Q%d %d/%d ... ", subNameLong[subsamp],
+           tests[i].jpegQual, tests[i].sf.num, tests[i].sf.denom);
+    TRY_TJ(tjTranscode(xhandle, jpegBuf, jpegSize, scaledWidth, scaledHeight,
+                       &dstJpegBuf, &dstJpegSize, tests[i].subsamp,
+                       tests[i].jpegQual, 0));
+    TRY_TJ(tjDecompressHeader2(dhandle, dstJpegBuf, dstJpegSize, &_hdrw,
+                               &_hdrh, &_hdrsubsamp));
+    if (_hdrw != scaledWidth || _hdrh != scaledHeight ||
+        _hdrsubsamp != subsamp)
+      THROW("Incorrect JPEG header");
+    TRY_TJ(tjDecompress2(dhandle, dstJpegBuf, dstJpegSize, dstBuf,
+                         scaledWidth, 0, scaledHeight, TJPF_RGB, 0));
+    if (checkBuf(dstBuf, scaledWidth, scaledHeight, TJPF_RGB, subsamp,
+                 tests[i].sf, 0))
+      printf("Passed.\n");
+    else printf("FAILED!\n");
+  }
+
+  /* Give Cr its own quantization table, so that the source image uses three
+     distinct tables, and make sure that they are passed through unchanged. */
+  printf("JPEG -> JPEG 3 quantization tables ... ");
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 75, 0));
+  if ((qtJpegBuf = (unsigned char *)malloc(jpegSize + 5 + 64)) == NULL)
+    THROW("Memory allocation failure");
+  memcpy(qtJpegBuf, jpegBuf, 2);
+  memcpy(&qtJpegBuf[2], "\xFF\xDB\x00\x43\x02", 5);
+  for (i = 0; i < 64; i++)
+    qtJpegBuf[7 + i] = (unsigned char)(2 + i % 7);
+  memcpy(&qtJpegBuf[7 + 64], &jpegBuf[2], jpegSize - 2);
+  qtJpegSize = jpegSize + 5 + 64;
+  for (i = 2; i + 4 <= (int)qtJpegSize && qtJpegBuf[i] == 0xFF;
+       i += 2 + ((qtJpegBuf[i + 2] << 8) | qtJpegBuf[i + 3])) {
+    if (qtJpegBuf[i + 1] == 0xC0) {
+      qtJpegBuf[i + 12 + 3 * 2] = 2;
+      break;
+    }
+  }
+  TRY_TJ(tjTranscode(xhandle, qtJpegBuf, qtJpegSize, w, h, &dstJpegBuf,
+                     &dstJpegSize, -1, -1, 0));
+  for (i = 0; i < 3; i++) {
+    unsigned char srcTable[64], dstTable[64];
+
+    if (getQuantTable(qtJpegBuf, qtJpegSize, i, srcTable) < 0 ||
+        getQuantTable(dstJpegBuf, dstJpegSize, i, dstTable) < 0)
+      THROW("Could not find quantization table");
+    if (memcmp(srcTable, dstTable, 64))
+      THROW("Quantization table was not passed through");
+  }
+  printf("Passed.\n");
+  printf("\n");
+
+bailout:
+  free(srcBuf);
+  free(dstBuf);
+  free(qtJpegBuf);
+  tjFree(jpegBuf);
+  tjFree(dstJpegBuf);
+  if (chandle) tjDestroy(chandle);
+  if (xhandle) tjDestroy(xhandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
+
+static void flatBlockTest(void)
+{
+  tjhandle handle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *refJpegBuf = NULL;
+  unsigned long jpegSize = 0, refJpegSize = 0;
+  int w = 256, h = 128, i, j, k, status;
+  static const struct {
+    int subsamp, jpegQual, flags;
+  } tests[] = {
+    { TJSAMP_444, 100, 0 },
+    { TJSAMP_444, 100, TJFLAG_FASTDCT },
+    { TJSAMP_420, 75, 0 },
+    { TJSAMP_420, 75, TJFLAG_FASTDCT },
+    { TJSAMP_GRAY, 95, 0 },
+    { TJSAMP_GRAY, 95, TJFLAG_FASTDCT }
+  };
+
+  if ((handle = tjInitCompress()) == NULL) THROW_TJ();
+
+  /* Fill the image with 16x16 tiles of solid color, so that every block
+     (including every subsampled chroma block) is flat.  The tiles cover the
+     full range of sample values, including 0 and 255. */
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (j = 0; j < h; j++)
+    for (i = 0; i < w; i++) {
+      int tile = (j / 16) * (w / 16) + i / 16;
+
+      for (k = 0; k < 3; k++)
+        srcBuf[(j * w + i) * 3 + k] =
+          tile == (w / 16) * (h / 16) - 1 ? 255 :
+          (unsigned char)(tile * (k * 2 + 1) * 37);
+    }
+
+  for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+    printf("Flat blocks %s Q%d %s ... ", subNameLong[tests[i].subsamp],
+           tests[i].jpegQual,
+           (tests[i].flags & TJFLAG_FASTDCT) ? "IFAST" : "ISLOW");
+    TRY_TJ(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                       &jpegSize, tests[i].subsamp, tests[i].jpegQual,
+                       tests[i].flags));
+    /* Compress the same image again with the flat block bypass disabled. */
+    setenv("JPEG_NOFLATBYPASS", "1", 1);
+    status = tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &refJpegBuf,
+                         &refJpegSize, tests[i].subsamp, tests[i].jpegQual,
+                         tests[i].flags);
+    setenv("JPEG_NOFLATBYPASS", "", 1);
+    if (status == -1) THROW_TJ();
+    if (refJpegSize != jpegSize || memcmp(refJpegBuf, jpegBuf, jpegSize))
+      THROW("JPEG image differs from the one generated without the flat block bypass");
+    printf("Passed.\n");
+  }
+  printf("\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf);
+  tjFree(refJpegBuf);
+  if (handle) tjDestroy(handle);
+}
+
+
+static void blockCacheTest(void)
+{
+  tjhandle handle = NULL, cacheHandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *cacheJpegBuf = NULL;
+  unsigned long jpegSize = 0, cacheJpegSize = 0;
+  int w = 64, h = 48, i, j;
+  static const struct {
+    int subsamp, jpegQual, flags;
+  } tests[] = {
+    { TJSAMP_444, 95, 0 },
+    { TJSAMP_444, 95, 0 },
+    { TJSAMP_420, 95, TJFLAG_ACCURATEDCT },
+    { TJSAMP_420, 75, TJFLAG_ACCURATEDCT },
+    { TJSAMP_GRAY, 75, 0 }
+  };
+
+  if ((handle = tjInitCompress()) == NULL ||
+      (cacheHandle = tjInitCompress()) == NULL)
+    THROW_TJ();
+
+  /* Tile a few distinct 8x8 patterns across the image, so that most blocks
+     are repeated but few are flat. */
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  for (j = 0; j < h; j++)
+    for (i = 0; i < w * 3; i++)
+      srcBuf[j * w * 3 + i] = (unsigned char)(((i / 24 + j / 8) % 3) * 64 +
+                                              (i % 24) * 5 + (j % 8) * 3);
+
+  for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+    printf("Block cache %s Q%d %s ... ", subNameLong[tests[i].subsamp],
+           tests[i].jpegQual,
+           (tests[i].flags & TJFLAG_ACCURATEDCT) ? "ISLOW" : "IFAST");
+    TRY_TJ(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                       &jpegSize, tests[i].subsamp, tests[i].jpegQual,
+                       tests[i].flags));
+    TRY_TJ(tjCompress2(cacheHandle, srcBuf, w, 0, h, TJPF_RGB, &cacheJpegBuf,
+                       &cacheJpegSize, tests[i].subsamp, tests[i].jpegQual,
+                       tests[i].flags | TJFLAG_BLOCKCACHE));
+    if (cacheJpegSize != jpegSize || memcmp(cacheJpegBuf, jpegBuf, jpegSize))
+      THROW("JPEG image differs from the one generated without the cache");
+    printf("Passed.\n");
+  }
+  printf("\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf);
+  tjFree(cacheJpegBuf);
+  if (handle) tjDestroy(handle);
+  if (cacheHandle) tjDestroy(cacheHandle);
+}
+
+
+static void incrementalTest(void)
+{
+  tjhandle handle = NULL, refHandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *refJpegBuf = NULL,
+    *bigBuf = NULL, *bigJpegBuf = NULL;
+  unsigned long jpegSize = 0, refJpegSize = 0, bigJpegSize = 0;
+  int w = 48, h = 41, bigw = 65501, flags = TJFLAG_INCREMENTAL, i, j;
+  static const struct {
+    int subsamp, flags, firstRow, nRows;
+  } tests[] = {
+    { TJSAMP_420, 0, 0, 0 },
+    { TJSAMP_420, 0, 20, 1 },
+    { TJSAMP_420, 0, 40, 1 },
+    { TJSAMP_420, 0, 0, 41 },
+    { TJSAMP_420, TJFLAG_BOTTOMUP, 5, 12 },
+    { TJSAMP_420, TJFLAG_BOTTOMUP, 0, 0 },
+    { TJSAMP_444, 0, 30, 2 },
+    { TJSAMP_GRAY, 0, 9, 1 }
+  };
+
+  if ((handle = tjInitCompress()) == NULL ||
+      (refHandle = tjInitCompress()) == NULL)
+    THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * 3)) == NULL)
+    THROW("Memory allocation failure");
+  initBuf(srcBuf, w, h, TJPF_RGB, 0);
+  if (!alloc) {
+    jpegSize = refJpegSize = tjBufSize(w, h, TJSAMP_444);
+    if ((jpegBuf = tjAlloc(jpegSize)) == NULL ||
+        (refJpegBuf = tjAlloc(refJpegSize)) == NULL)
+      THROW("Memory allocation failure");
+  }
+
+  for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+    flags = tests[i].flags | TJFLAG_INCREMENTAL;
+    if (!alloc) flags |= TJFLAG_NOREALLOC;
+    printf("Incremental %s %s %2d rows changed ... ",
+           subNameLong[tests[i].subsamp],
+           (tests[i].flags & TJFLAG_BOTTOMUP) ? "Bottom-Up" : "Top-Down ",
+           tests[i].nRows);
+    for (j = tests[i].firstRow * w * 3;
+         j < (tests[i].firstRow + tests[i].nRows) * w * 3; j++)
+      srcBuf[j] = (unsigned char)(srcBuf[j] + 37 * (i + 1));
+
+    /* The incremental JPEG image must be identical to the one generated by a
+       fresh instance, which always compresses the whole image. */
+    TRY_TJ(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                       tests[i].subsamp, 90, flags));
+    tjDestroy(refHandle);
+    if ((refHandle = tjInitCompress()) == NULL) THROW_TJ();
+    /* The new instance may grow refJpegBuf even though it was allocated by
+       the old one. */
+    TRY_TJ(tjCompress2(refHandle, srcBuf, w, 0, h, TJPF_RGB, &refJpegBuf,
+                       &refJpegSize, tests[i].subsamp, 90, flags));
+    if (jpegSize != refJpegSize || memcmp(jpegBuf, refJpegBuf, jpegSize))
+      THROW("JPEG image differs from the one generated from scratch");
+    printf("Passed.\n");
+  }
+
+  /* A JPEG library error (in this case, an image that is too wide) must not
+     leak the temporary buffers used for incremental compression or leave
+     stale state behind. */
+  printf("Incremental error handling ... ");
+  if (!alloc) flags |= TJFLAG_NOREALLOC;
+  if ((bigBuf = (unsigned char *)calloc(bigw * 3, 8)) == NULL)
+    THROW("Memory allocation failure");
+  if (!alloc) {
+    bigJpegSize = tjBufSize(bigw, 8, TJSAMP_GRAY);
+    if ((bigJpegBuf = tjAlloc(bigJpegSize)) == NULL)
+      THROW("Memory allocation failure");
+  }
+  if (tjCompress2(handle, bigBuf, bigw, 0, 8, TJPF_RGB, &bigJpegBuf,
+                  &bigJpegSize, TJSAMP_GRAY, 90, flags) == 0)
+    THROW("Oversized image was not rejected");
+  TRY_TJ(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     TJSAMP_GRAY, 90, flags));
+  if (jpegSize != refJpegSize || memcmp(jpegBuf, refJpegBuf, jpegSize))
+    THROW("JPEG image differs from the one generated from scratch");
+  printf("Passed.\n");
+  printf("\n");
+
+bailout:
+  free(srcBuf);
+  free(bigBuf);
+  tjFree(bigJpegBuf);
+  tjFree(jpegBuf);
+  tjFree(refJpegBuf);
+  if (handle) tjDestroy(handle);
+  if (refHandle) tjDestroy(refHandle);
+}
+
+
+static void regionsTest(void)
+{
+  tjhandle handle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBufs[5], *jpegBuf = NULL;
+  unsigned long jpegSizes[5], jpegSize = 0;
+  int w = 100, h = 70, pf = TJPF_BGRX, ps = tjPixelSize[TJPF_BGRX];
+  int pitch = w * ps + 12, i, r;
+  static const tjregion regions[5] = {
+    { 0, 0, 16, 16 }, { 3, 5, 17, 9 }, { 84, 54, 16, 16 }, { 0, 0, 100, 70 },
+    { 99, 0, 1, 70 }
+  };
+
+  for (r = 0; r < 5; r++) {
+    jpegBufs[r] = NULL;  jpegSizes[r] = 0;
+  }
+
+  if ((handle = tjInitCompress()) == NULL) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(pitch * h)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < pitch * h; i++)
+    srcBuf[i] = (unsigned char)((i % pitch) * 3 + (i / pitch) * 7);
+
+  for (i = 0; i < 2; i++) {
+    int flags = i ? TJFLAG_BOTTOMUP : 0;
+
+    printf("Regions %s ... ", i ? "Bottom-Up" : "Top-Down ");
+    TRY_TJ(tjCompressRegions(handle, srcBuf, w, pitch, h, pf, regions, 5,
+                             jpegBufs, jpegSizes, TJSAMP_420, 80, flags));
+    for (r = 0; r < 5; r++) {
+      int row = i ? h - regions[r].y - regions[r].h : regions[r].y;
+
+      TRY_TJ(tjCompress2(handle, &srcBuf[row * pitch + regions[r].x * ps],
+                         regions[r].w, pitch, regions[r].h, pf, &jpegBuf,
+                         &jpegSize, TJSAMP_420, 80, flags));
+      if (jpegSize != jpegSizes[r] || memcmp(jpegBuf, jpegBufs[r], jpegSize))
+        THROW("JPEG image differs from the one generated by tjCompress2()");
+    }
+    printf("Passed.\n");
+  }
+  printf("\n");
+
+bailout:
+  free(srcBuf);
+  for (r = 0; r < 5; r++) tjFree(jpegBufs[r]);
+  tjFree(jpegBuf);
+  if (handle) tjDestroy(handle);
+}
+
+
+static void previewTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *fullBuf = NULL,
+    *previewBuf = NULL;
+  unsigned long jpegSize = 0;
+  int w = 97, h = 65, pf = TJPF_RGB, ps = tjPixelSize[TJPF_RGB], i;
+
+  if ((chandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (fullBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (previewBuf = (unsigned char *)malloc(w * h * ps)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * ps; i++)
+    srcBuf[i] = (unsigned char)((i % (w * ps)) * 3 + (i / (w * ps)) * 7);
+
+  printf("Progressive preview ... ");
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 90, TJFLAG_PROGRESSIVE));
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, fullBuf, w, 0, h, pf, 0));
+
+  /* Using all scans should produce the same image as tjDecompress2(). */
+  TRY_TJ(tjDecompressPreview(dhandle, jpegBuf, jpegSize, 0, previewBuf, w, 0,
+                             h, pf, 0));
+  if (memcmp(previewBuf, fullBuf, w * h * ps))
+    THROW("Preview using all scans differs from full decompression");
+  TRY_TJ(tjDecompressPreview(dhandle, jpegBuf, jpegSize, 1000, previewBuf, w,
+                             0, h, pf, 0));
+  if (memcmp(previewBuf, fullBuf, w * h * ps))
+    THROW("Preview using all scans differs from full decompression");
+
+  /* Using only the first scan (the DC coefficients) should produce a
+     different, lower-quality image. */
+  TRY_TJ(tjDecompressPreview(dhandle, jpegBuf, jpegSize, 1, previewBuf, w, 0,
+                             h, pf, 0));
+  if (!memcmp(previewBuf, fullBuf, w * h * ps))
+    THROW("Preview using one scan is identical to full decompression");
+
+  /* A truncated JPEG image should produce a preview along with a warning. */
+  if (tjDecompressPreview(dhandle, jpegBuf, jpegSize / 2, 0, previewBuf, w, 0,
+                          h, pf, 0) == 0 ||
+      tjGetErrorCode(dhandle) != TJERR_WARNING)
+    THROW("Truncated JPEG image did not generate a warning");
+  if (tjDecompressPreview(dhandle, jpegBuf, jpegSize / 2, 0, previewBuf, w, 0,
+                          h, pf, TJFLAG_STOPONWARNING) == 0)
+    THROW("Truncated JPEG image did not generate an error");
+
+  /* The decompressor should still be usable after a preview. */
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, previewBuf, w, 0, h, pf,
+                       0));
+  if (memcmp(previewBuf, fullBuf, w * h * ps))
+    THROW("Decompression after preview differs from full decompression");
+  printf("Passed.\n\n");
+
+bailout:
+  free(srcBuf);
+  free(fullBuf);
+  free(previewBuf);
+  tjFree(jpegBuf);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
+
+static int hashDistance(const unsigned char *hash1,
+                        const unsigned char *hash2)
+{
+  int i, distance = 0;
+
+  for (i = 0; i < 64; i++)
+    if ((hash1[i / 8] ^ hash2[i / 8]) & (0x80 >> (i % 8))) distance++;
+  return distance;
+}
+
+
+static void dcTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *grayBuf = NULL,
+    *dcBuf = NULL;
+  unsigned long jpegSize = 0;
+  int w = 97, h = 65, pf = TJPF_RGB, ps = tjPixelSize[TJPF_RGB], i, x, y,
+    sw = (w + 7) / 8, sh = (h + 7) / 8;
+  double sum[3] = { 0., 0., 0. };
+  tjdcsummary summary, summary2;
+
+  if ((chandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (grayBuf = (unsigned char *)malloc(sw * sh)) == NULL ||
+      (dcBuf = (unsigned char *)malloc(sw * sh)) == NULL)
+    THROW("Memory allocation failure");
+  for (y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      unsigned char *pixel = &srcBuf[(y * w + x) * ps];
+
+      pixel[0] = (unsigned char)(x * 255 / (w - 1));
+      pixel[1] = (unsigned char)(((x - w / 2) * (x - w / 2) +
+                                  (y - h / 2) * (y - h / 2)) % 256);
+      pixel[2] = (unsigned char)(y * 255 / (h - 1));
+      for (i = 0; i < 3; i++) sum[i] += pixel[i];
+    }
+  }
+
+  printf("DC-only analysis ... ");
+
+  /* The grayscale image should be identical to the luminance image produced
+     by decompressing with 1/8 scaling. */
+  for (i = 0; i < TJ_NUMSAMP; i++) {
+    tjFree(jpegBuf);  jpegBuf = NULL;
+    TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize, i,
+                       95, 0));
+    TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, grayBuf, sw, 0, sh,
+                         TJPF_GRAY, 0));
+    TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, dcBuf, 0, &summary,
+                          0));
+    if (memcmp(dcBuf, grayBuf, sw * sh))
+      THROW("DC grayscale image differs from 1/8-scale luminance image");
+  }
+  tjFree(jpegBuf);  jpegBuf = NULL;
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 95, 0));
+  TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, dcBuf, 0, &summary, 0));
+  TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, dcBuf, 0, NULL,
+                        TJFLAG_BOTTOMUP));
+  for (y = 0; y < sh; y++)
+    if (memcmp(&dcBuf[(sh - y - 1) * sw], &grayBuf[y * sw], sw))
+      THROW("Bottom-up DC grayscale image is incorrect");
+
+  for (i = 0; i < 3; i++) {
+    int avg = (int)(sum[i] / (w * h) + 0.5);
+
+    if (abs((int)summary.avgColor[i] - avg) > 4)
+      THROW("Average color is incorrect");
+  }
+
+  /* The hash should be insensitive to the compression quality but sensitive
+     to the content of the image. */
+  tjFree(jpegBuf);  jpegBuf = NULL;
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize,
+                     TJSAMP_444, 50, 0));
+  TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, NULL, 0, &summary2, 0));
+  if (hashDistance(summary.hash, summary2.hash) > 8)
+    THROW("Hashes of similar images differ too much");
+  for (i = 0; i < w * h * ps; i++) srcBuf[i] = 255 - srcBuf[i];
+  tjFree(jpegBuf);  jpegBuf = NULL;
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 95, 0));
+  TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, NULL, 0, &summary2, 0));
+  if (hashDistance(summary.hash, summary2.hash) < 32)
+    THROW("Hashes of dissimilar images are too similar");
+
+  /* Grayscale JPEG images should produce a gray average color. */
+  tjFree(jpegBuf);  jpegBuf = NULL;
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize,
+                     TJSAMP_GRAY, 95, 0));
+  TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, NULL, 0, &summary2, 0));
+  if (summary2.avgColor[0] != summary2.avgColor[1] ||
+      summary2.avgColor[0] != summary2.avgColor[2])
+    THROW("Average color of grayscale image is not gray");
+
+  /* Progressive JPEG images should produce the same grayscale image as
+     1/8-scale decompression. */
+  tjFree(jpegBuf);  jpegBuf = NULL;
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 95, TJFLAG_PROGRESSIVE));
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, grayBuf, sw, 0, sh,
+                       TJPF_GRAY, 0));
+  TRY_TJ(tjDecompressDC(dhandle, jpegBuf, jpegSize, dcBuf, 0, NULL, 0));
+  if (memcmp(dcBuf, grayBuf, sw * sh))
+    THROW("DC grayscale image differs from 1/8-scale luminance image");
+
+  if (tjDecompressDC(dhandle, jpegBuf, jpegSize, NULL, 0, NULL, 0) == 0)
+    THROW("tjDecompressDC() accepted invalid arguments");
+  printf("Passed.\n\n");
+
+bailout:
+  free(srcBuf);
+  free(grayBuf);
+  free(dcBuf);
+  tjFree(jpegBuf);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
+
+/* Cancel the transform that is in progress with the instance passed in the
+   transform's data field */
+static int cancelFilter(short *coeffs, tjregion arrayRegion,
+                        tjregion planeRegion, int componentIndex,
+                        int transformIndex, tjtransform *transform)
+{
+  return tjCancel((tjhandle)transform->data);
+}
+
+
+static void abortTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL, thandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *dstBuf = NULL,
+    *yuvBuf = NULL, *jpegBuf2 = NULL;
+  unsigned long jpegSize = 0, jpegSize2 = 0;
+  int w = 1024, h = 1024, ps = tjPixelSize[TJPF_RGB], i;
+  tjtransform xform;
+
+  if ((chandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+  if ((thandle = tjInitTransform()) == NULL) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (dstBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (yuvBuf = (unsigned char *)malloc(tjBufSizeYUV2(w, 4, h,
+                                                      TJSAMP_420))) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * ps; i++)
+    srcBuf[i] = (unsigned char)((i * 7) ^ (i / (w * ps) * 13));
+  memset(yuvBuf, 128, tjBufSizeYUV2(w, 4, h, TJSAMP_420));
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 95, TJFLAG_PROGRESSIVE));
+
+  printf("Operation timeout and cancellation ... ");
+
+  /* A cancellation request made while no operation is in progress should
+     have no effect. */
+  TRY_TJ(tjCancel(dhandle));
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+  if (tjGetErrorCode(dhandle) == TJERR_ABORTED)
+    THROW("Successful operation reported TJERR_ABORTED");
+  TRY_TJ(tjCancel(chandle));
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf2,
+                     &jpegSize2, TJSAMP_420, 95, 0));
+
+  /* Cancelling a transform from within its custom filter should abort the
+     compression side of the transform, and only that transform. */
+  memset(&xform, 0, sizeof(tjtransform));
+  xform.customFilter = cancelFilter;
+  xform.data = thandle;
+  tjFree(jpegBuf2);  jpegBuf2 = NULL;
+  if (tjTransform(thandle, jpegBuf, jpegSize, 1, &jpegBuf2, &jpegSize2,
+                  &xform, 0) == 0)
+    THROW("Cancelled operation succeeded");
+  if (tjGetErrorCode(thandle) != TJERR_ABORTED)
+    THROW("Cancelled operation did not report TJERR_ABORTED");
+  xform.customFilter = NULL;
+  tjFree(jpegBuf2);  jpegBuf2 = NULL;
+  TRY_TJ(tjTransform(thandle, jpegBuf, jpegSize, 1, &jpegBuf2, &jpegSize2,
+                     &xform, 0));
+
+  /* Decompressing a 1-megapixel progressive JPEG image takes well over a
+     millisecond. */
+  TRY_TJ(tjSetTimeout(dhandle, 1));
+  if (tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Operation that exceeded the time limit succeeded");
+  if (tjGetErrorCode(dhandle) != TJERR_ABORTED)
+    THROW("Timed-out operation did not report TJERR_ABORTED");
+  TRY_TJ(tjSetTimeout(dhandle, 0));
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+  if (tjSetTimeout(dhandle, -1) == 0)
+    THROW("tjSetTimeout() accepted an invalid argument");
+
+  /* Compressing a 1-megapixel progressive JPEG image also takes well over a
+     millisecond. */
+  TRY_TJ(tjSetTimeout(chandle, 1));
+  tjFree(jpegBuf2);  jpegBuf2 = NULL;
+  if (tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf2, &jpegSize2,
+                  TJSAMP_420, 95, TJFLAG_PROGRESSIVE) == 0)
+    THROW("Operation that exceeded the time limit succeeded");
+  if (tjGetErrorCode(chandle) != TJERR_ABORTED)
+    THROW("Timed-out operation did not report TJERR_ABORTED");
+  TRY_TJ(tjSetTimeout(chandle, 0));
+  tjFree(jpegBuf2);  jpegBuf2 = NULL;
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf2,
+                     &jpegSize2, TJSAMP_420, 95, TJFLAG_PROGRESSIVE));
+
+  /* The instance should remain usable for operations that do not install the
+     progress monitor. */
+  TRY_TJ(tjDecodeYUV(dhandle, yuvBuf, 4, TJSAMP_420, dstBuf, w, 0, h,
+                     TJPF_RGB, 0));
+  printf("Passed.\n\n");
+
+bailout:
+  free(srcBuf);
+  free(dstBuf);
+  free(yuvBuf);
+  tjFree(jpegBuf);
+  tjFree(jpegBuf2);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+  if (thandle) tjDestroy(thandle);
+}
+
+
+static void limitsTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL, thandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *progBuf = NULL,
+    *dstBuf = NULL, *xformBuf = NULL;
+  unsigned long jpegSize = 0, progSize = 0, xformSize = 0;
+  int w = 97, h = 165, ps = tjPixelSize[TJPF_RGB], i;
+  tjlimits limits;
+  tjtransform xform;
+
+  if ((chandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+  if ((thandle = tjInitTransform()) == NULL) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (dstBuf = (unsigned char *)malloc(w * h * ps)) == NULL)
+    THROW("Memory allocation failure");
+  for (i = 0; i < w * h * ps; i++) srcBuf[i] = (unsigned char)(i * 3);
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+                     TJSAMP_420, 95, 0));
+  TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &progBuf, &progSize,
+                     TJSAMP_420, 95, TJFLAG_PROGRESSIVE));
+
+  printf("Resource limits ... ");
+
+  memset(&limits, 0, sizeof(tjlimits));
+  limits.maxPixels = w * h - 1;
+  TRY_TJ(tjSetLimits(dhandle, &limits));
+  if (tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Pixel limit was not enforced");
+  limits.maxPixels = w * h;
+  TRY_TJ(tjSetLimits(dhandle, &limits));
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+
+  /* The coefficient memory limit applies only to operations that buffer the
+     whole image.  The 4:2:0 image has 13 x 21 luminance blocks (rounded up
+     to 14 x 22) and 7 x 11 blocks per chrominance component. */
+  memset(&limits, 0, sizeof(tjlimits));
+  limits.maxCoefMemory = (14 * 22 + 2 * 7 * 11) * 128 - 1;
+  TRY_TJ(tjSetLimits(dhandle, &limits));
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+  if (tjDecompress2(dhandle, progBuf, progSize, dstBuf, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Coefficient memory limit was not enforced");
+  TRY_TJ(tjSetLimits(thandle, &limits));
+  memset(&xform, 0, sizeof(tjtransform));
+  xform.op = TJXOP_HFLIP;
+  if (tjTransform(thandle, jpegBuf, jpegSize, 1, &xformBuf, &xformSize,
+                  &xform, 0) == 0)
+    THROW("Coefficient memory limit was not enforced by tjTransform()");
+  limits.maxCoefMemory++;
+  TRY_TJ(tjSetLimits(dhandle, &limits));
+  TRY_TJ(tjDecompress2(dhandle, progBuf, progSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+
+  memset(&limits, 0, sizeof(tjlimits));
+  limits.maxMemory = 10000;
+  TRY_TJ(tjSetLimits(dhandle, &limits));
+  if (tjDecompress2(dhandle, progBuf, progSize, dstBuf, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Memory limit was not enforced");
+
+  memset(&limits, 0, sizeof(tjlimits));
+  limits.maxScans = 2;
+  TRY_TJ(tjSetLimits(dhandle, &limits));
+  if (tjDecompress2(dhandle, progBuf, progSize, dstBuf, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Scan limit was not enforced");
+  TRY_TJ(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+
+  TRY_TJ(tjSetLimits(dhandle, NULL));
+  TRY_TJ(tjDecompress2(dhandle, progBuf, progSize, dstBuf, w, 0, h, TJPF_RGB,
+                       0));
+  limits.maxScans = -1;
+  if (tjSetLimits(dhandle, &limits) == 0)
+    THROW("tjSetLimits() accepted an invalid argument");
+  if (tjSetLimits(chandle, NULL) == 0)
+    THROW("tjSetLimits() accepted a compressor instance");
+
+  /* A memory limit of 0 should preserve the limit set with JPEGMEM. */
+  tjDestroy(dhandle);
+  setenv("JPEGMEM", "10", 1);
+  dhandle = tjInitDecompress();
+  setenv("JPEGMEM", "", 1);
+  if (dhandle == NULL) THROW_TJ();
+  TRY_TJ(tjSetLimits(dhandle, NULL));
+  if (tjDecompress2(dhandle, progBuf, progSize, dstBuf, w, 0, h, TJPF_RGB,
+                    0) == 0)
+    THROW("Memory limit from JPEGMEM was not preserved");
+  printf("Passed.\n\n");
+
+bailout:
+  free(srcBuf);
+  free(dstBuf);
+  tjFree(jpegBuf);
+  tjFree(progBuf);
+  tjFree(xformBuf);
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+  if (thandle) tjDestroy(thandle);
+}
+
+
+typedef struct {
+  unsigned char *planes[3];
+  int strides[3], nextRow[3], calls, failAt;
+} yuvRowsData;
+
+
+static int yuvRowHandler(const unsigned char **planes, const int *strides,
+                         const tjregion *regions, int numPlanes, void *data)
+{
+  yuvRowsData *d = (yuvRowsData *)data;
+  int i, row;
+
+  if (d->calls++ == d->failAt) return -1;
+  for (i = 0; i < numPlanes; i++) {
+    if (regions[i].x != 0 || regions[i].y != d->nextRow[i] ||
+        regions[i].h < 1 || strides[i] < regions[i].w)
+      return -1;
+    for (row = 0; row < regions[i].h; row++)
+      memcpy(&d->planes[i][(regions[i].y + row) * d->strides[i]],
+             &planes[i][row * strides[i]], regions[i].w);
+    d->nextRow[i] += regions[i].h;
+  }
+  return 0;
+}
+
+
+static void yuvRowsTest(void)
+{
+  tjhandle chandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL, *jpegBuf = NULL, *refPlanes[3] = { NULL },
+    *rowPlanes[3] = { NULL };
+  unsigned long jpegSize = 0;
+  int i, t, ps = tjPixelSize[TJPF_RGB], numPlanes;
+  static const int tests[][5] = {
+    /* width, height, subsamp, scaling factor numerator, denominator */
+    { 41, 35, TJSAMP_420, 1, 1 }, { 41, 35, TJSAMP_420, 1, 2 },
+    { 35, 39, TJSAMP_422, 1, 1 }, { 39, 41, TJSAMP_440, 3, 4 },
+    { 35, 39, TJSAMP_411, 1, 1 }, { 48, 48, TJSAMP_444, 1, 1 },
+    { 39, 41, TJSAMP_GRAY, 1, 1 }
+  };
+  yuvRowsData d;
+
+  if ((chandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+
+  printf("Zero-copy YUV decompression ... ");
+
+  for (t = 0; t < (int)(sizeof(tests) / sizeof(tests[0])); t++) {
+    int w = tests[t][0], h = tests[t][1], subsamp = tests[t][2];
+    tjscalingfactor sf;
+    int sw, sh, strides[3];
+
+    sf.num = tests[t][3];  sf.denom = tests[t][4];
+    sw = TJSCALED(w, sf);  sh = TJSCALED(h, sf);
+    numPlanes = subsamp == TJSAMP_GRAY ? 1 : 3;
+
+    if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL)
+      THROW("Memory allocation failure");
+    for (i = 0; i < w * h * ps; i++)
+      srcBuf[i] = (unsigned char)((i * 7) ^ (i / (w * ps) * 13));
+    TRY_TJ(tjCompress2(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+                       &jpegSize, subsamp, 90, 0));
+
+    memset(&d, 0, sizeof(yuvRowsData));
+    d.failAt = -1;
+    for (i = 0; i < numPlanes; i++) {
+      int size = tjPlaneSizeYUV(i, sw, 0, sh, subsamp);
+
+      strides[i] = d.strides[i] = tjPlaneWidth(i, sw, subsamp);
+      if ((refPlanes[i] = (unsigned char *)malloc(size)) == NULL ||
+          (rowPlanes[i] = (unsigned char *)malloc(size)) == NULL)
+        THROW("Memory allocation failure");
+      d.planes[i] = rowPlanes[i];
+    }
+    TRY_TJ(tjDecompressToYUVPlanes(dhandle, jpegBuf, jpegSize, refPlanes, sw,
+                                   strides, sh, 0));
+    TRY_TJ(tjDecompressToYUVRows(dhandle, jpegBuf, jpegSize, sw, sh,
+                                 yuvRowHandler, &d, 0));
+    for (i = 0; i < numPlanes; i++) {
+      if (d.nextRow[i] != tjPlaneHeight(i, sh, subsamp))
+        THROW("Row handler did not receive all rows");
+      if (memcmp(refPlanes[i], rowPlanes[i],
+                 tjPlaneSizeYUV(i, sw, 0, sh, subsamp)))
+        THROW("Zero-copy YUV decompression gave different result");
+    }
+
+    /* An error in the row handler should abort decompression. */
+    memset(d.nextRow, 0, sizeof(d.nextRow));
+    d.calls = 0;  d.failAt = 1;
+    if (tjDecompressToYUVRows(dhandle, jpegBuf, jpegSize, sw, sh,
+                              yuvRowHandler, &d, 0) == 0)
+      THROW("Error in row handler was ignored");
+    if (d.calls != 2)
+      THROW("Decompression was not aborted");
+
+    free(srcBuf);  srcBuf = NULL;
+    tjFree(jpegBuf);  jpegBuf = NULL;
+    for (i = 0; i < 3; i++) {
+      free(refPlanes[i]);  refPlanes[i] = NULL;
+      free(rowPlanes[i]);  rowPlanes[i] = NULL;
+    }
+  }
+  printf("Passed.\n\n");
+
+bailout:
+  free(srcBuf);
+  tjFree(jpegBuf);
+  for (i = 0; i < 3; i++) {
+    free(refPlanes[i]);
+    free(rowPlanes[i]);
+  }
+  if (chandle) tjDestroy(chandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
+
+/* Remove all marker segments of the specified type that precede the first
+   SOS marker */
+static void stripMarker(unsigned char *jpegBuf, unsigned long *jpegSize,
+                        int marker)
+{
+  unsigned long pos = 2, len;
+
+  while (pos + 4 <= *jpegSize && jpegBuf[pos] == 0xFF &&
+         jpegBuf[pos + 1] != 0xDA) {
+    len = 2 + ((jpegBuf[pos + 2] << 8) | jpegBuf[pos + 3]);
+    if (jpegBuf[pos + 1] == marker) {
+      memmove(&jpegBuf[pos], &jpegBuf[pos + len], *jpegSize - pos - len);
+      *jpegSize -= len;
+    } else
+      pos += len;
+  }
+}
+
+
+static void mjpegTest(void)
+{
+  tjhandle chandle = NULL, ohandle = NULL, dhandle = NULL;
+  unsigned char *srcBuf = NULL,
+    *jpegBufs[5] = { NULL, NULL, NULL, NULL, NULL }, *streamBuf = NULL,
+    *dstBuf = NULL, *refBufs[5] = { NULL, NULL, NULL, NULL, NULL };
+  unsigned long jpegSizes[5] = { 0, 0, 0, 0, 0 }, streamSize = 0, pos = 0,
+    frameSize = 0;
+  int w = 48, h = 32, ps = tjPixelSize[TJPF_RGB], i, frame;
+  static const unsigned char padding[3] = { 0x00, 0xFF, 0x00 };
+
+  if ((chandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((ohandle = tjInitCompress()) == NULL) THROW_TJ();
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+
+  if ((srcBuf = (unsigned char *)malloc(w * h * ps)) == NULL ||
+      (dstBuf = (unsigned char *)malloc(w * h * ps)) == NULL)
+    THROW("Memory allocation failure");
+
+  /* Frame 1 repeats the tables of frame 0.  Frame 2 uses optimized Huffman
+     tables, and frames 3 and 4 switch back to the standard Huffman tables.
+     The optimized tables stay in the compressor object and would be reused
+     for subsequent images, so frame 2 is generated with its own compressor. */
+  for (frame = 0; frame < 5; frame++) {
+    for (i = 0; i < w * h * ps; i++)
+      srcBuf[i] = (unsigned char)(i * 3 + frame * 40);
+    setenv("TJ_OPTIMIZE", frame == 2 ? "1" : "0", 1);
+    TRY_TJ(tjCompress2(frame == 2 ? ohandle : chandle, srcBuf, w, 0, h,
+                       TJPF_RGB, &jpegBufs[frame], &jpegSizes[frame],
+                       TJSAMP_422, frame < 2 ? 90 : 50, 0));
+    if ((refBufs[frame] = (unsigned char *)malloc(w * h * ps)) == NULL)
+      THROW("Memory allocation failure");
+    TRY_TJ(tjDecompress2(dhandle, jpegBufs[frame], jpegSizes[frame],
+                         refBufs[frame], w, 0, h, TJPF_RGB, 0));
+  }
+  tjDestroy(dhandle);
+  if ((dhandle = tjInitDecompress()) == NULL) THROW_TJ();
+
+  printf("Motion-JPEG decompression ... ");
+
+  /* A frame without Huffman tables should be decompressed using the standard
+     tables. */
+  stripMarker(jpegBufs[1], &jpegSizes[1], 0xC4);
+  TRY_TJ(tjDecompressMJPEG(dhandle, jpegBufs[1], jpegSizes[1], &frameSize,
+                           dstBuf, w, 0, h, TJPF_RGB, 0));
+  if (frameSize != jpegSizes[1] || memcmp(dstBuf, refBufs[1], w * h * ps))
+    THROW("Frame without Huffman tables was not decompressed correctly");
+
+  /* A frame without quantization tables should use those of the previous
+     frame. */
+  stripMarker(jpegBufs[4], &jpegSizes[4], 0xC4);
+  stripMarker(jpegBufs[4], &jpegSizes[4], 0xDB);
+
+  if ((streamBuf = (unsigned char *)malloc(jpegSizes[0] + jpegSizes[1] +
+                                           jpegSizes[2] + jpegSizes[3] +
+                                           jpegSizes[4] +
+                                           3 * sizeof(padding))) == NULL)
+    THROW("Memory allocation failure");
+  for (frame = 0; frame < 5; frame++) {
+    if (frame == 0 || frame == 2) {
+      memcpy(&streamBuf[streamSize], padding, sizeof(padding));
+      streamSize += sizeof(padding);
+    }
+    memcpy(&streamBuf[streamSize], jpegBufs[frame], jpegSizes[frame]);
+    streamSize += jpegSizes[frame];
+  }
+  memcpy(&streamBuf[streamSize], padding, sizeof(padding));
+  streamSize += sizeof(padding);
+
+  for (frame = 0; frame < 5; frame++) {
+    TRY_TJ(tjDecompressMJPEG(dhandle, &streamBuf[pos], streamSize - pos,
+                             &frameSize, dstBuf, w, 0, h, TJPF_RGB, 0));
+    pos += frameSize;
+    if (memcmp(dstBuf, refBufs[frame], w * h * ps))
+      THROW("Frame was not decompressed correctly");
+  }
+  if (pos != streamSize - sizeof(padding))
+    THROW("Incorrect number of bytes consumed");
+
+  /* The trailing padding contains no frame. */
+  if (tjDecompressMJPEG(dhandle, &streamBuf[pos], streamSize - pos,
+                        &frameSize, dstBuf, w, 0, h, TJPF_RGB, 0) == 0)
+    THROW("Decompressing a stream with no frames succeeded");
+  if (frameSize != streamSize - pos)
+    THROW("Incorrect number of bytes consumed");
+
+  /* A rejected frame should still be skipped, even if it starts the stream. */
+  if (tjDecompressMJPEG(dhandle, jpegBufs[0], jpegSizes[0], &frameSize,
+                        dstBuf, w, 0, h, -1, 0) == 0)
+    THROW("Decompressing with an invalid pixel format succeeded");
+  if (frameSize < 2)
+    THROW("Rejected frame was not skipped");
+  printf("Passed.\n\n");
+
+bailout:
+  free(srcBuf);
+  free(dstBuf);
+  free(streamBuf);
+  for (frame = 0; frame < 5; frame++) {
+    tjFree(jpegBufs[frame]);
+    free(refBufs[frame]);
+  }
+  if (chandle) tjDestroy(chandle);
+  if (ohandle) tjDestroy(ohandle);
+  if (dhandle) tjDestroy(dhandle);
+}
+
+
 static void initBitmap(unsigned char *buf, int width, int pitch, int height,
                        int pf, int flags)
 {
@@ -915,6 +1949,17 @@ int main(int argc, char *argv[])
   doTest(39, 41, _onlyGray, 1, TJSAMP_GRAY, "test");
   doTest(41, 35, _3byteFormats, 2, TJSAMP_GRAY, "test");
   doTest(35, 39, _4byteFormats, 4, TJSAMP_GRAY, "test");
+  if (!doYUV) transcodeTest();
+  if (!doYUV) flatBlockTest();
+  if (!doYUV) blockCacheTest();
+  if (!doYUV) incrementalTest();
+  if (!doYUV) regionsTest();
+  if (!doYUV) previewTest();
+  if (!doYUV) dcTest();
+  if (!doYUV) abortTest();
+  if (!doYUV) limitsTest();
+  if (!doYUV) mjpegTest();
+  if (!doYUV) yuvRowsTest();
   bufSizeTest();
   if (doYUV) {
     printf("\n--------------------\n\n");
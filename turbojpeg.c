@@ -38,6 +38,11 @@
 #include <jerror.h>
 #include <setjmp.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
 #include "./turbojpeg.h"
 #include "./tjutil.h"
 #include "transupp.h"
@@ -103,6 +108,27 @@ static void my_emit_message(j_common_ptr cinfo, int msg_level)
 
 enum { COMPRESS = 1, DECOMPRESS = 2 };
 
+/* State retained between images compressed with TJFLAG_INCREMENTAL */
+typedef struct {
+  /* Parameters of the previous image */
+  int width, height, pixelFormat, subsamp, jpegQual, flags;
+  int nBands;                   /* number of MCU rows (restart intervals) */
+  unsigned char *srcCopy;       /* previous source image, top-down, packed */
+  unsigned char *header;        /* all markers up to and including SOS */
+  unsigned long headerSize;
+  unsigned char *segData;       /* entropy-coded segments, back to back */
+  unsigned long *segOffset;     /* nBands + 1 offsets into segData */
+} tjincstate;
+
+/* Temporary buffers used while compressing an image with TJFLAG_INCREMENTAL.
+   These are kept in the instance so that tjCompress2() can free them if a
+   JPEG library error longjmp()s out of compressIncremental(). */
+typedef struct {
+  unsigned long *segStart, *segEnd, *segOffset;
+  unsigned char *changed, *segData;
+  JSAMPROW *band_pointer;
+} tjinctemp;
+
 typedef struct _tjinstance {
   struct jpeg_compress_struct cinfo;
   struct jpeg_decompress_struct dinfo;
@@ -110,31 +136,162 @@ typedef struct _tjinstance {
   int init, headerRead;
   char errStr[JMSG_LENGTH_MAX];
   boolean isInstanceError;
+  void *blockCache;
+  tjincstate *incState;
+  tjinctemp incTemp;
+  unsigned long timeout;        /* time limit per operation (ms), 0 = none */
+  volatile sig_atomic_t cancelled;  /* set asynchronously by tjCancel() */
+  boolean aborted;              /* last operation was cancelled/timed out */
+  tjlimits limits;              /* resource limits set with tjSetLimits() */
+  long defaultMaxMemory;        /* max_memory_to_use (from JPEGMEM) */
 } tjinstance;
 
+/* Signal an instance error from within the libjpeg API */
+
+static void throwFromLibjpeg(tjinstance *this, const char *msg)
+{
+  snprintf(this->errStr, JMSG_LENGTH_MAX, "%s", msg);
+  snprintf(errStr, JMSG_LENGTH_MAX, "%s", msg);
+  this->isInstanceError = TRUE;
+  this->jerr.warning = FALSE;
+  longjmp(this->jerr.setjmp_buffer, 1);
+}
+
+/* Return a millisecond count for measuring elapsed time.  The count may wrap
+   around, so only differences between counts are meaningful. */
+
+static unsigned long getTimeMs(void)
+{
+#ifdef _WIN32
+  /* clock() measures wall-clock time on Windows. */
+  return (unsigned long)(clock() / (CLOCKS_PER_SEC / 1000));
+#else
+  struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+  /* Unlike gettimeofday(), the monotonic clock isn't affected by changes to
+     the system time. */
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (unsigned long)ts.tv_sec * 1000UL +
+           (unsigned long)ts.tv_nsec / 1000000UL;
+#endif
+
+  if (gettimeofday(&tv, NULL) < 0) return 0;
+  return (unsigned long)tv.tv_sec * 1000UL +
+         (unsigned long)tv.tv_usec / 1000UL;
+#endif
+}
+
 struct my_progress_mgr {
   struct jpeg_progress_mgr pub;
   tjinstance *this;
+  int maxScans;                 /* 0 = no limit */
+  unsigned long startTime;
 };
 typedef struct my_progress_mgr *my_progress_ptr;
 
-static void my_progress_monitor(j_common_ptr dinfo)
+static void my_progress_monitor(j_common_ptr cinfo)
+{
+  my_progress_ptr myprog = (my_progress_ptr)cinfo->progress;
+  tjinstance *this = myprog->this;
+
+  if (this->cancelled) {
+    this->cancelled = 0;
+    this->aborted = TRUE;
+    throwFromLibjpeg(this, "Operation was cancelled");
+  } else if (this->timeout &&
+             getTimeMs() - myprog->startTime >= this->timeout) {
+    this->aborted = TRUE;
+    throwFromLibjpeg(this, "Operation exceeded the time limit");
+  } else if (myprog->maxScans && cinfo->is_decompressor &&
+             ((j_decompress_ptr)cinfo)->input_scan_number > myprog->maxScans) {
+    char msg[JMSG_LENGTH_MAX];
+
+    snprintf(msg, JMSG_LENGTH_MAX,
+             "Progressive JPEG image has more than %d scans",
+             myprog->maxScans);
+    throwFromLibjpeg(this, msg);
+  }
+}
+
+/* Install the progress monitor, which enforces TJFLAG_LIMITSCANS, the scan
+   limit set with tjSetLimits(), tjSetTimeout(), and tjCancel(), in a
+   decompressor instance.  A transformer instance also installs the same
+   progress monitor in its compressor. */
+
+static void setDecompProgress(tjinstance *this,
+                              struct my_progress_mgr *progress, int flags)
+{
+  MEMZERO(progress, sizeof(struct my_progress_mgr));
+  progress->pub.progress_monitor = my_progress_monitor;
+  progress->this = this;
+  progress->maxScans = (flags & TJFLAG_LIMITSCANS) ? 500 : 0;
+  if (this->limits.maxScans > 0 &&
+      (!progress->maxScans || this->limits.maxScans < progress->maxScans))
+    progress->maxScans = this->limits.maxScans;
+  if (this->timeout) progress->startTime = getTimeMs();
+  this->dinfo.progress = &progress->pub;
+}
+
+/* Install the progress monitor, which enforces tjSetTimeout() and tjCancel(),
+   in a compressor instance */
+
+static void setCompProgress(tjinstance *this,
+                            struct my_progress_mgr *progress)
+{
+  MEMZERO(progress, sizeof(struct my_progress_mgr));
+  progress->pub.progress_monitor = my_progress_monitor;
+  progress->this = this;
+  if (this->timeout) progress->startTime = getTimeMs();
+  this->cinfo.progress = &progress->pub;
+}
+
+/* Pass the scanlines to the compressor one iMCU row at a time, so that the
+   progress monitor (which jpeg_write_scanlines() calls once per call) can
+   abort the operation between iMCU rows. */
+
+static void writeScanlines(j_compress_ptr cinfo, JSAMPROW *row_pointer)
 {
-  my_error_ptr myerr = (my_error_ptr)dinfo->err;
-  my_progress_ptr myprog = (my_progress_ptr)dinfo->progress;
+  JDIMENSION rowsPerIMCU = cinfo->max_v_samp_factor * DCTSIZE;
+
+  while (cinfo->next_scanline < cinfo->image_height)
+    jpeg_write_scanlines(cinfo, &row_pointer[cinfo->next_scanline],
+                         MIN(cinfo->image_height - cinfo->next_scanline,
+                             rowsPerIMCU));
+}
 
-  if (dinfo->is_decompressor) {
-    int scan_no = ((j_decompress_ptr)dinfo)->input_scan_number;
+/* Enforce the pixel and coefficient memory limits set with tjSetLimits()
+   after the JPEG header has been read.  wholeImage indicates that the caller
+   buffers the coefficients for the whole image even if the image has only one
+   scan. */
 
-    if (scan_no > 500) {
-      snprintf(myprog->this->errStr, JMSG_LENGTH_MAX,
-               "Progressive JPEG image has more than 500 scans");
-      snprintf(errStr, JMSG_LENGTH_MAX,
-               "Progressive JPEG image has more than 500 scans");
-      myprog->this->isInstanceError = TRUE;
-      myerr->warning = FALSE;
-      longjmp(myerr->setjmp_buffer, 1);
+static void checkLimits(tjinstance *this, boolean wholeImage)
+{
+  j_decompress_ptr dinfo = &this->dinfo;
+  int ci;
+
+  if (this->limits.maxPixels &&
+      (unsigned long)dinfo->image_width * dinfo->image_height >
+      this->limits.maxPixels)
+    throwFromLibjpeg(this, "JPEG image exceeds the pixel limit");
+
+  if (this->limits.maxCoefMemory &&
+      (wholeImage || jpeg_has_multiple_scans(dinfo))) {
+    double coefMemory = 0.;
+
+    for (ci = 0; ci < dinfo->num_components; ci++) {
+      jpeg_component_info *compptr = &dinfo->comp_info[ci];
+
+      coefMemory += (double)jround_up((long)compptr->width_in_blocks,
+                                      (long)compptr->h_samp_factor) *
+                    (double)jround_up((long)compptr->height_in_blocks,
+                                      (long)compptr->v_samp_factor) *
+                    sizeof(JBLOCK);
     }
+    if (coefMemory > (double)this->limits.maxCoefMemory)
+      throwFromLibjpeg(this,
+                       "JPEG image exceeds the coefficient memory limit");
   }
 }
 
@@ -220,7 +377,21 @@ static int cs2pf[JPEG_NUMCS] = {
   } \
   cinfo = &this->cinfo;  dinfo = &this->dinfo; \
   this->jerr.warning = FALSE; \
-  this->isInstanceError = FALSE;
+  this->isInstanceError = FALSE; \
+  this->aborted = FALSE; \
+  this->cancelled = 0;
+
+#define GET_TJINSTANCE(handle) \
+  tjinstance *this = (tjinstance *)handle; \
+  \
+  if (!this) { \
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle"); \
+    return -1; \
+  } \
+  this->jerr.warning = FALSE; \
+  this->isInstanceError = FALSE; \
+  this->aborted = FALSE; \
+  this->cancelled = 0;
 
 #define GET_CINSTANCE(handle) \
   tjinstance *this = (tjinstance *)handle; \
@@ -232,7 +403,9 @@ static int cs2pf[JPEG_NUMCS] = {
   } \
   cinfo = &this->cinfo; \
   this->jerr.warning = FALSE; \
-  this->isInstanceError = FALSE;
+  this->isInstanceError = FALSE; \
+  this->aborted = FALSE; \
+  this->cancelled = 0;
 
 #define GET_DINSTANCE(handle) \
   tjinstance *this = (tjinstance *)handle; \
@@ -244,7 +417,9 @@ static int cs2pf[JPEG_NUMCS] = {
   } \
   dinfo = &this->dinfo; \
   this->jerr.warning = FALSE; \
-  this->isInstanceError = FALSE;
+  this->isInstanceError = FALSE; \
+  this->aborted = FALSE; \
+  this->cancelled = 0;
 
 static int getPixelFormat(int pixelSize, int flags)
 {
@@ -438,11 +613,87 @@ DLLEXPORT int tjGetErrorCode(tjhandle handle)
 {
   tjinstance *this = (tjinstance *)handle;
 
-  if (this && this->jerr.warning) return TJERR_WARNING;
+  if (this && this->aborted) return TJERR_ABORTED;
+  else if (this && this->jerr.warning) return TJERR_WARNING;
   else return TJERR_FATAL;
 }
 
 
+DLLEXPORT int tjSetTimeout(tjhandle handle, int msec)
+{
+  int retval = 0;
+
+  GET_TJINSTANCE(handle);
+
+  if (msec < 0) THROW("tjSetTimeout(): Invalid argument");
+  this->timeout = (unsigned long)msec;
+
+bailout:
+  return retval;
+}
+
+
+DLLEXPORT int tjSetLimits(tjhandle handle, const tjlimits *limits)
+{
+  int retval = 0;
+
+  GET_DINSTANCE(handle);
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjSetLimits(): Instance has not been initialized for decompression");
+
+  if (limits && limits->maxScans < 0)
+    THROW("tjSetLimits(): Invalid argument");
+  if (limits) this->limits = *limits;
+  else MEMZERO(&this->limits, sizeof(tjlimits));
+
+  /* The libjpeg memory manager refuses to allocate whole-image buffers that
+     would cause its total allocation to exceed max_memory_to_use. */
+  dinfo->mem->max_memory_to_use = this->limits.maxMemory ?
+    (long)this->limits.maxMemory : this->defaultMaxMemory;
+
+bailout:
+  return retval;
+}
+
+
+DLLEXPORT int tjCancel(tjhandle handle)
+{
+  tjinstance *this = (tjinstance *)handle;
+
+  /* This may be called from another thread while an operation is in
+     progress, so it must not modify any other instance state. */
+  if (!this) {
+    snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle");
+    return -1;
+  }
+  this->cancelled = 1;
+  return 0;
+}
+
+
+static void freeIncState(tjincstate *state)
+{
+  if (state == NULL) return;
+  free(state->srcCopy);
+  free(state->header);
+  free(state->segData);
+  free(state->segOffset);
+  free(state);
+}
+
+
+static void freeIncTemp(tjinctemp *temp)
+{
+  free(temp->segStart);
+  free(temp->segEnd);
+  free(temp->segOffset);
+  free(temp->changed);
+  free(temp->segData);
+  free(temp->band_pointer);
+  MEMZERO(temp, sizeof(tjinctemp));
+}
+
+
 DLLEXPORT int tjDestroy(tjhandle handle)
 {
   GET_INSTANCE(handle);
@@ -450,6 +701,7 @@ DLLEXPORT int tjDestroy(tjhandle handle)
   if (setjmp(this->jerr.setjmp_buffer)) return -1;
   if (this->init & COMPRESS) jpeg_destroy_compress(cinfo);
   if (this->init & DECOMPRESS) jpeg_destroy_decompress(dinfo);
+  freeIncState(this->incState);
   free(this);
   return 0;
 }
@@ -663,6 +915,260 @@ bailout:
 }
 
 
+/* Locate the entropy-coded segments in a single-scan JPEG image.  Returns the
+   size of the headers (all markers up to and including SOS), or -1 if the
+   image does not contain exactly nSegs restart intervals. */
+static long findSegments(const unsigned char *buf, unsigned long size,
+                         int nSegs, unsigned long *segStart,
+                         unsigned long *segEnd)
+{
+  unsigned long pos = 2, headerSize;
+  int seg = 0, marker;
+
+  if (size < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return -1;
+  do {
+    if (pos + 4 > size || buf[pos] != 0xFF) return -1;
+    marker = buf[pos + 1];
+    pos += 2 + ((buf[pos + 2] << 8) | buf[pos + 3]);
+  } while (marker != 0xDA);
+  headerSize = pos;
+
+  segStart[0] = pos;
+  for (; pos + 1 < size; pos++) {
+    if (buf[pos] != 0xFF || buf[pos + 1] == 0) continue;
+    marker = buf[pos + 1];
+    if (marker != 0xD9 && (marker < 0xD0 || marker > 0xD7)) return -1;
+    if (seg >= nSegs) return -1;
+    segEnd[seg++] = pos;
+    if (marker == 0xD9) break;
+    pos++;
+    segStart[seg] = pos + 1;
+  }
+  if (seg != nSegs || marker != 0xD9) return -1;
+  return (long)headerSize;
+}
+
+
+/* Write raw bytes to the JPEG destination manager */
+static void writeBytes(j_compress_ptr cinfo, const unsigned char *buf,
+                       unsigned long size)
+{
+  struct jpeg_destination_mgr *dest = cinfo->dest;
+
+  while (size > 0) {
+    size_t n;
+
+    if (dest->free_in_buffer == 0)
+      (*dest->empty_output_buffer) (cinfo);
+    n = MIN(size, dest->free_in_buffer);
+    MEMCOPY(dest->next_output_byte, buf, n);
+    dest->next_output_byte += n;
+    dest->free_in_buffer -= n;
+    buf += n;
+    size -= n;
+  }
+}
+
+
+#define INC_FLAGS  (TJFLAG_FASTDCT | TJFLAG_ACCURATEDCT)
+
+/* Compress an image with one restart interval per MCU row, re-encoding only
+   the MCU rows that differ from the previous image compressed with this
+   instance and splicing the entropy-coded segments of the others from the
+   previous JPEG image.  Called by tjCompress2() after the compression
+   parameters have been set.  JPEG library errors are handled by the caller's
+   setjmp() context. */
+static int compressIncremental(tjinstance *this, JSAMPROW *row_pointer,
+                               int width, int height, int pixelFormat,
+                               unsigned char **jpegBuf,
+                               unsigned long *jpegSize, int jpegSubsamp,
+                               int jpegQual, int flags)
+{
+  j_compress_ptr cinfo = &this->cinfo;
+  tjincstate *state = this->incState;
+  int bandHeight = tjMCUHeight[jpegSubsamp];
+  int nBands = (height + bandHeight - 1) / bandHeight, nChanged = 0;
+  size_t rowSize = (size_t)width * tjPixelSize[pixelFormat];
+  int retval = 0, alloc = !(flags & TJFLAG_NOREALLOC), b, i;
+  tjinctemp *temp = &this->incTemp;
+  unsigned long segSize = 0;
+  long headerSize;
+
+  /* Discard the saved state if it doesn't match this image. */
+  if (state &&
+      (state->width != width || state->height != height ||
+       state->pixelFormat != pixelFormat || state->subsamp != jpegSubsamp ||
+       state->jpegQual != jpegQual || state->flags != (flags & INC_FLAGS))) {
+    freeIncState(state);
+    this->incState = state = NULL;
+  }
+
+  if ((temp->segStart = (unsigned long *)malloc(sizeof(unsigned long) *
+                                                nBands)) == NULL ||
+      (temp->segEnd = (unsigned long *)malloc(sizeof(unsigned long) *
+                                              nBands)) == NULL ||
+      (temp->segOffset = (unsigned long *)malloc(sizeof(unsigned long) *
+                                                 (nBands + 1))) == NULL ||
+      (temp->changed = (unsigned char *)malloc(nBands)) == NULL)
+    THROW("tjCompress2(): Memory allocation failure");
+
+  cinfo->restart_interval = 0;
+  cinfo->restart_in_rows = 1;
+
+  if (state == NULL) {
+    /* Compress the whole image, then save its segments for the next call. */
+    jpeg_start_compress(cinfo, TRUE);
+    if (flags & TJFLAG_BLOCKCACHE)
+      jinit_fdct_block_cache(cinfo, &this->blockCache);
+    writeScanlines(cinfo, row_pointer);
+    jpeg_finish_compress(cinfo);
+
+    /* If the restart intervals don't line up with the MCU rows (which can
+       happen with extremely wide images), then the next image will also be
+       compressed in full. */
+    headerSize = findSegments(*jpegBuf, *jpegSize, nBands, temp->segStart,
+                              temp->segEnd);
+    if (headerSize < 0) goto bailout;
+
+    if ((state = (tjincstate *)malloc(sizeof(tjincstate))) == NULL)
+      THROW("tjCompress2(): Memory allocation failure");
+    MEMZERO(state, sizeof(tjincstate));
+    this->incState = state;
+    state->width = width;  state->height = height;
+    state->pixelFormat = pixelFormat;  state->subsamp = jpegSubsamp;
+    state->jpegQual = jpegQual;  state->flags = flags & INC_FLAGS;
+    state->nBands = nBands;
+    state->headerSize = (unsigned long)headerSize;
+    segSize = temp->segEnd[nBands - 1] - temp->segStart[0];
+    if ((state->srcCopy = (unsigned char *)malloc(rowSize * height)) == NULL ||
+        (state->header = (unsigned char *)malloc(headerSize)) == NULL ||
+        (state->segData = (unsigned char *)malloc(segSize)) == NULL ||
+        (state->segOffset = (unsigned long *)malloc(sizeof(unsigned long) *
+                                                    (nBands + 1))) == NULL)
+      THROW("tjCompress2(): Memory allocation failure");
+    MEMCOPY(state->header, *jpegBuf, headerSize);
+    segSize = 0;
+    for (b = 0; b < nBands; b++) {
+      state->segOffset[b] = segSize;
+      MEMCOPY(&state->segData[segSize], &(*jpegBuf)[temp->segStart[b]],
+              temp->segEnd[b] - temp->segStart[b]);
+      segSize += temp->segEnd[b] - temp->segStart[b];
+    }
+    state->segOffset[nBands] = segSize;
+    for (i = 0; i < height; i++)
+      MEMCOPY(&state->srcCopy[rowSize * i], row_pointer[i], rowSize);
+    goto bailout;
+  }
+
+  /* Find the MCU rows that have changed since the previous image. */
+  for (b = 0; b < nBands; b++) {
+    int endRow = MIN((b + 1) * bandHeight, height);
+
+    temp->changed[b] = 0;
+    for (i = b * bandHeight; i < endRow; i++) {
+      if (memcmp(row_pointer[i], &state->srcCopy[rowSize * i], rowSize)) {
+        temp->changed[b] = 1;  nChanged++;
+        break;
+      }
+    }
+  }
+
+  if (nChanged > 0) {
+    /* Compress only the changed MCU rows, stacked into a single image.  The
+       restart interval resets the DC predictors at the start of each MCU row,
+       and each MCU row depends only on its own source rows, so the
+       entropy-coded segments are identical to those of a full compression.
+       The last MCU row of the source image, which may be partial, is always
+       last in the stack if it has changed. */
+    int nRows = 0;
+
+    if ((temp->band_pointer = (JSAMPROW *)malloc(sizeof(JSAMPROW) *
+                                                 nChanged * bandHeight)) ==
+        NULL)
+      THROW("tjCompress2(): Memory allocation failure");
+    for (b = 0; b < nBands; b++) {
+      int endRow = MIN((b + 1) * bandHeight, height);
+
+      if (!temp->changed[b]) continue;
+      for (i = b * bandHeight; i < endRow; i++)
+        temp->band_pointer[nRows++] = row_pointer[i];
+    }
+
+    cinfo->image_height = nRows;
+    jpeg_start_compress(cinfo, TRUE);
+    if (flags & TJFLAG_BLOCKCACHE)
+      jinit_fdct_block_cache(cinfo, &this->blockCache);
+    writeScanlines(cinfo, temp->band_pointer);
+    jpeg_finish_compress(cinfo);
+    cinfo->image_height = height;
+
+    if (findSegments(*jpegBuf, *jpegSize, nChanged, temp->segStart,
+                     temp->segEnd) < 0)
+      THROW("tjCompress2(): Could not locate restart intervals");
+  }
+
+  /* Merge the new segments with the unchanged ones. */
+  segSize = 0;
+  for (b = 0, i = 0; b < nBands; b++) {
+    if (temp->changed[b]) {
+      segSize += temp->segEnd[i] - temp->segStart[i];  i++;
+    } else
+      segSize += state->segOffset[b + 1] - state->segOffset[b];
+  }
+  if ((temp->segData = (unsigned char *)malloc(segSize)) == NULL)
+    THROW("tjCompress2(): Memory allocation failure");
+  segSize = 0;
+  for (b = 0, i = 0; b < nBands; b++) {
+    temp->segOffset[b] = segSize;
+    if (temp->changed[b]) {
+      MEMCOPY(&temp->segData[segSize], &(*jpegBuf)[temp->segStart[i]],
+              temp->segEnd[i] - temp->segStart[i]);
+      segSize += temp->segEnd[i] - temp->segStart[i];  i++;
+    } else {
+      MEMCOPY(&temp->segData[segSize], &state->segData[state->segOffset[b]],
+              state->segOffset[b + 1] - state->segOffset[b]);
+      segSize += state->segOffset[b + 1] - state->segOffset[b];
+    }
+  }
+  temp->segOffset[nBands] = segSize;
+  free(state->segData);
+  state->segData = temp->segData;  temp->segData = NULL;
+  free(state->segOffset);
+  state->segOffset = temp->segOffset;  temp->segOffset = NULL;
+  for (b = 0; b < nBands; b++) {
+    int endRow = MIN((b + 1) * bandHeight, height);
+
+    if (!temp->changed[b]) continue;
+    for (i = b * bandHeight; i < endRow; i++)
+      MEMCOPY(&state->srcCopy[rowSize * i], row_pointer[i], rowSize);
+  }
+
+  /* Write the saved headers and the segments, with fresh RSTn markers. */
+  if (!alloc) *jpegSize = tjBufSize(width, height, jpegSubsamp);
+  jpeg_mem_dest_tj(cinfo, jpegBuf, jpegSize, alloc);
+  (*cinfo->dest->init_destination) (cinfo);
+  writeBytes(cinfo, state->header, state->headerSize);
+  for (b = 0; b < nBands; b++) {
+    unsigned char marker[2];
+
+    writeBytes(cinfo, &state->segData[state->segOffset[b]],
+               state->segOffset[b + 1] - state->segOffset[b]);
+    marker[0] = 0xFF;
+    marker[1] = (b < nBands - 1) ? (unsigned char)(0xD0 + (b & 7)) : 0xD9;
+    writeBytes(cinfo, marker, 2);
+  }
+  (*cinfo->dest->term_destination) (cinfo);
+
+bailout:
+  if (retval < 0) {
+    freeIncState(this->incState);
+    this->incState = NULL;
+  }
+  freeIncTemp(temp);
+  return retval;
+}
+
+
 DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
                           int width, int pitch, int height, int pixelFormat,
                           unsigned char **jpegBuf, unsigned long *jpegSize,
@@ -670,6 +1176,7 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
 {
   int i, retval = 0, alloc = 1;
   JSAMPROW *row_pointer = NULL;
+  struct my_progress_mgr progress;
 
   GET_CINSTANCE(handle)
   this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
@@ -687,6 +1194,8 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
   if ((row_pointer = (JSAMPROW *)malloc(sizeof(JSAMPROW) * height)) == NULL)
     THROW("tjCompress2(): Memory allocation failure");
 
+  setCompProgress(this, &progress);
+
   if (setjmp(this->jerr.setjmp_buffer)) {
     /* If we get here, the JPEG code has signaled an error. */
     retval = -1;  goto bailout;
@@ -707,19 +1216,134 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
   jpeg_mem_dest_tj(cinfo, jpegBuf, jpegSize, alloc);
   setCompDefaults(cinfo, pixelFormat, jpegSubsamp, jpegQual, flags);
 
-  jpeg_start_compress(cinfo, TRUE);
   for (i = 0; i < height; i++) {
     if (flags & TJFLAG_BOTTOMUP)
       row_pointer[i] = (JSAMPROW)&srcBuf[(height - i - 1) * (size_t)pitch];
     else
       row_pointer[i] = (JSAMPROW)&srcBuf[i * (size_t)pitch];
   }
-  while (cinfo->next_scanline < cinfo->image_height)
-    jpeg_write_scanlines(cinfo, &row_pointer[cinfo->next_scanline],
-                         cinfo->image_height - cinfo->next_scanline);
+
+  /* Incremental compression requires fixed Huffman tables and a single
+     scan. */
+  if ((flags & TJFLAG_INCREMENTAL) && !cinfo->optimize_coding &&
+      !cinfo->arith_code && cinfo->scan_info == NULL) {
+    retval = compressIncremental(this, row_pointer, width, height,
+                                 pixelFormat, jpegBuf, jpegSize, jpegSubsamp,
+                                 jpegQual, flags);
+    goto bailout;
+  }
+
+  jpeg_start_compress(cinfo, TRUE);
+  if (flags & TJFLAG_BLOCKCACHE)
+    jinit_fdct_block_cache(cinfo, &this->blockCache);
+  writeScanlines(cinfo, row_pointer);
   jpeg_finish_compress(cinfo);
 
 bailout:
+  cinfo->progress = NULL;
+  if (cinfo->global_state > CSTATE_START) {
+    if (alloc) (*cinfo->dest->term_destination) (cinfo);
+    jpeg_abort_compress(cinfo);
+  }
+  free(row_pointer);
+  if (flags & TJFLAG_INCREMENTAL) {
+    /* A JPEG library error may have bypassed compressIncremental()'s own
+       cleanup. */
+    freeIncTemp(&this->incTemp);
+    if (retval < 0) {
+      freeIncState(this->incState);
+      this->incState = NULL;
+    }
+  }
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+DLLEXPORT int tjCompressRegions(tjhandle handle, const unsigned char *srcBuf,
+                                int width, int pitch, int height,
+                                int pixelFormat, const tjregion *regions,
+                                int numRegions, unsigned char **jpegBufs,
+                                unsigned long *jpegSizes, int jpegSubsamp,
+                                int jpegQual, int flags)
+{
+  int i, r, retval = 0, alloc = 1, maxHeight = 0;
+  JSAMPROW *row_pointer = NULL;
+  struct my_progress_mgr progress;
+
+  GET_CINSTANCE(handle)
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & COMPRESS) == 0)
+    THROW("tjCompressRegions(): Instance has not been initialized for compression");
+
+  if (srcBuf == NULL || width <= 0 || pitch < 0 || height <= 0 ||
+      pixelFormat < 0 || pixelFormat >= TJ_NUMPF || regions == NULL ||
+      numRegions < 0 || jpegBufs == NULL || jpegSizes == NULL ||
+      jpegSubsamp < 0 || jpegSubsamp >= NUMSUBOPT || jpegQual < 0 ||
+      jpegQual > 100)
+    THROW("tjCompressRegions(): Invalid argument");
+
+  for (r = 0; r < numRegions; r++) {
+    if (regions[r].x < 0 || regions[r].y < 0 || regions[r].w <= 0 ||
+        regions[r].h <= 0 || regions[r].x > width - regions[r].w ||
+        regions[r].y > height - regions[r].h)
+      THROW("tjCompressRegions(): Invalid region");
+    maxHeight = MAX(maxHeight, regions[r].h);
+  }
+  if (numRegions == 0) goto bailout;
+
+  if (pitch == 0) pitch = width * tjPixelSize[pixelFormat];
+
+  if ((row_pointer = (JSAMPROW *)malloc(sizeof(JSAMPROW) * maxHeight)) ==
+      NULL)
+    THROW("tjCompressRegions(): Memory allocation failure");
+
+  setCompProgress(this, &progress);
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+  if (flags & TJFLAG_NOREALLOC) alloc = 0;
+
+  /* The compression parameters (including the quantization and Huffman
+     tables) persist across images, so set them up only once.  Only the image
+     dimensions change from one region to the next. */
+  cinfo->image_width = regions[0].w;
+  cinfo->image_height = regions[0].h;
+  setCompDefaults(cinfo, pixelFormat, jpegSubsamp, jpegQual, flags);
+
+  for (r = 0; r < numRegions; r++) {
+    const tjregion *rgn = &regions[r];
+
+    cinfo->image_width = rgn->w;
+    cinfo->image_height = rgn->h;
+    if (!alloc) jpegSizes[r] = tjBufSize(rgn->w, rgn->h, jpegSubsamp);
+    jpeg_mem_dest_tj(cinfo, &jpegBufs[r], &jpegSizes[r], alloc);
+
+    jpeg_start_compress(cinfo, TRUE);
+    if (flags & TJFLAG_BLOCKCACHE)
+      jinit_fdct_block_cache(cinfo, &this->blockCache);
+    for (i = 0; i < rgn->h; i++) {
+      int row = (flags & TJFLAG_BOTTOMUP) ? height - rgn->y - i - 1 :
+                                            rgn->y + i;
+
+      row_pointer[i] = (JSAMPROW)&srcBuf[row * (size_t)pitch +
+                                         rgn->x * tjPixelSize[pixelFormat]];
+    }
+    writeScanlines(cinfo, row_pointer);
+    jpeg_finish_compress(cinfo);
+  }
+
+bailout:
+  cinfo->progress = NULL;
   if (cinfo->global_state > CSTATE_START) {
     if (alloc) (*cinfo->dest->term_destination) (cinfo);
     jpeg_abort_compress(cinfo);
@@ -730,6 +1354,7 @@ bailout:
   return retval;
 }
 
+
 DLLEXPORT int tjCompress(tjhandle handle, unsigned char *srcBuf, int width,
                          int pitch, int height, int pixelSize,
                          unsigned char *jpegBuf, unsigned long *jpegSize,
@@ -981,6 +1606,7 @@ DLLEXPORT int tjCompressFromYUVPlanes(tjhandle handle,
     tmpbufsize = 0, usetmpbuf = 0, th[MAX_COMPONENTS];
   JSAMPLE *_tmpbuf = NULL, *ptr;
   JSAMPROW *inbuf[MAX_COMPONENTS], *tmpbuf[MAX_COMPONENTS];
+  struct my_progress_mgr progress;
 
   GET_CINSTANCE(handle)
   this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
@@ -999,6 +1625,8 @@ DLLEXPORT int tjCompressFromYUVPlanes(tjhandle handle,
   if (subsamp != TJSAMP_GRAY && (!srcPlanes[1] || !srcPlanes[2]))
     THROW("tjCompressFromYUVPlanes(): Invalid argument");
 
+  setCompProgress(this, &progress);
+
   if (setjmp(this->jerr.setjmp_buffer)) {
     /* If we get here, the JPEG code has signaled an error. */
     retval = -1;  goto bailout;
@@ -1021,6 +1649,8 @@ DLLEXPORT int tjCompressFromYUVPlanes(tjhandle handle,
   cinfo->raw_data_in = TRUE;
 
   jpeg_start_compress(cinfo, TRUE);
+  if (flags & TJFLAG_BLOCKCACHE)
+    jinit_fdct_block_cache(cinfo, &this->blockCache);
   for (i = 0; i < cinfo->num_components; i++) {
     jpeg_component_info *compptr = &cinfo->comp_info[i];
     int ih;
@@ -1091,6 +1721,7 @@ DLLEXPORT int tjCompressFromYUVPlanes(tjhandle handle,
   jpeg_finish_compress(cinfo);
 
 bailout:
+  cinfo->progress = NULL;
   if (cinfo->global_state > CSTATE_START) {
     if (alloc) (*cinfo->dest->term_destination) (cinfo);
     jpeg_abort_compress(cinfo);
@@ -1169,6 +1800,7 @@ static tjhandle _tjInitDecompress(tjinstance *this)
   }
 
   jpeg_create_decompress(&this->dinfo);
+  this->defaultMaxMemory = this->dinfo.mem->max_memory_to_use;
   /* Make an initial call so it will create the source manager */
   jpeg_mem_src_tj(&this->dinfo, buffer, 1);
 
@@ -1299,13 +1931,7 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
   else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
 #endif
 
-  if (flags & TJFLAG_LIMITSCANS) {
-    MEMZERO(&progress, sizeof(struct my_progress_mgr));
-    progress.pub.progress_monitor = my_progress_monitor;
-    progress.this = this;
-    dinfo->progress = &progress.pub;
-  } else
-    dinfo->progress = NULL;
+  setDecompProgress(this, &progress, flags);
 
   if (setjmp(this->jerr.setjmp_buffer)) {
     /* If we get here, the JPEG code has signaled an error. */
@@ -1314,8 +1940,10 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
 
   jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
   jpeg_read_header(dinfo, TRUE);
+  checkLimits(this, FALSE);
   this->dinfo.out_color_space = pf2cs[pixelFormat];
   if (flags & TJFLAG_FASTDCT) this->dinfo.dct_method = JDCT_FASTEST;
+  else if (flags & TJFLAG_AUTODCT) this->dinfo.dct_method = JDCT_AUTO;
   if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
 
   jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
@@ -1355,6 +1983,7 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
   jpeg_finish_decompress(dinfo);
 
 bailout:
+  dinfo->progress = NULL;
   if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
   free(row_pointer);
   if (this->jerr.warning) retval = -1;
@@ -1362,68 +1991,468 @@ bailout:
   return retval;
 }
 
-DLLEXPORT int tjDecompress(tjhandle handle, unsigned char *jpegBuf,
-                           unsigned long jpegSize, unsigned char *dstBuf,
-                           int width, int pitch, int height, int pixelSize,
-                           int flags)
-{
-  if (flags & TJ_YUV)
-    return tjDecompressToYUV(handle, jpegBuf, jpegSize, dstBuf, flags);
-  else
-    return tjDecompress2(handle, jpegBuf, jpegSize, dstBuf, width, pitch,
-                         height, getPixelFormat(pixelSize, flags), flags);
-}
-
 
-static int setDecodeDefaults(struct jpeg_decompress_struct *dinfo,
-                             int pixelFormat, int subsamp, int flags)
+DLLEXPORT int tjDecompressMJPEG(tjhandle handle,
+                                const unsigned char *mjpegBuf,
+                                unsigned long mjpegSize,
+                                unsigned long *frameSize,
+                                unsigned char *dstBuf, int width, int pitch,
+                                int height, int pixelFormat, int flags)
 {
-  int i;
-
-  dinfo->scale_num = dinfo->scale_denom = 1;
-
-  if (subsamp == TJSAMP_GRAY) {
-    dinfo->num_components = dinfo->comps_in_scan = 1;
-    dinfo->jpeg_color_space = JCS_GRAYSCALE;
-  } else {
-    dinfo->num_components = dinfo->comps_in_scan = 3;
-    dinfo->jpeg_color_space = JCS_YCbCr;
-  }
+  unsigned long offset = 0;
+  int retval = 0;
 
-  dinfo->comp_info = (jpeg_component_info *)
-    (*dinfo->mem->alloc_small) ((j_common_ptr)dinfo, JPOOL_IMAGE,
-                                dinfo->num_components *
-                                sizeof(jpeg_component_info));
+  GET_DINSTANCE(handle);
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressMJPEG(): Instance has not been initialized for decompression");
 
-  for (i = 0; i < dinfo->num_components; i++) {
-    jpeg_component_info *compptr = &dinfo->comp_info[i];
+  if (mjpegBuf == NULL || mjpegSize <= 0 || frameSize == NULL)
+    THROW("tjDecompressMJPEG(): Invalid argument");
+  *frameSize = 0;
 
-    compptr->h_samp_factor = (i == 0) ? tjMCUWidth[subsamp] / 8 : 1;
-    compptr->v_samp_factor = (i == 0) ? tjMCUHeight[subsamp] / 8 : 1;
-    compptr->component_index = i;
-    compptr->component_id = i + 1;
-    compptr->quant_tbl_no = compptr->dc_tbl_no =
-      compptr->ac_tbl_no = (i == 0) ? 0 : 1;
-    dinfo->cur_comp_info[i] = compptr;
+  /* Skip any padding or container data that precedes the SOI marker. */
+  while (offset + 1 < mjpegSize &&
+         (mjpegBuf[offset] != 0xFF || mjpegBuf[offset + 1] != 0xD8))
+    offset++;
+  if (offset + 1 >= mjpegSize) {
+    *frameSize = mjpegSize;
+    THROW("tjDecompressMJPEG(): No JPEG frame found");
   }
-  dinfo->data_precision = 8;
-  for (i = 0; i < 2; i++) {
-    if (dinfo->quant_tbl_ptrs[i] == NULL)
-      dinfo->quant_tbl_ptrs[i] = jpeg_alloc_quant_table((j_common_ptr)dinfo);
+
+  /* Point the source manager at the frame here as well, so that the number
+     of bytes consumed is correct even if tjDecompress2() rejects its
+     arguments. */
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
   }
+  jpeg_mem_src_tj(dinfo, &mjpegBuf[offset], mjpegSize - offset);
 
-  return 0;
-}
+  /* Successive frames usually share the same Huffman tables, so keep the
+     derived tables for the lifetime of the instance. */
+  jinit_d_derived_tbl_cache(dinfo);
 
+  /* The decompressor stops reading immediately after the EOI marker, so the
+     source manager is left pointing to the end of the frame.  The tables
+     persist in the decompressor, so no special handling is needed for frames
+     that omit them. */
+  retval = tjDecompress2(handle, &mjpegBuf[offset], mjpegSize - offset,
+                         dstBuf, width, pitch, height, pixelFormat, flags);
+  *frameSize = mjpegSize - (unsigned long)dinfo->src->bytes_in_buffer;
 
-static int my_read_markers(j_decompress_ptr dinfo)
-{
-  return JPEG_REACHED_SOS;
+bailout:
+  /* If the frame was rejected before any of it was read, then consume at least
+     its SOI marker, so that a caller skipping corrupt frames makes progress. */
+  if (retval < 0 && frameSize != NULL && offset + 2 <= mjpegSize &&
+      *frameSize < offset + 2)
+    *frameSize = offset + 2;
+  return retval;
 }
 
-static void my_reset_marker_reader(j_decompress_ptr dinfo)
+
+DLLEXPORT int tjDecompressPreview(tjhandle handle,
+                                  const unsigned char *jpegBuf,
+                                  unsigned long jpegSize, int numScans,
+                                  unsigned char *dstBuf, int width, int pitch,
+                                  int height, int pixelFormat, int flags)
 {
-}
+  JSAMPROW *row_pointer = NULL;
+  int i, retval = 0, jpegwidth, jpegheight, scaledw, scaledh, scan, status;
+  struct my_progress_mgr progress;
+
+  GET_DINSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressPreview(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || numScans < 0 || dstBuf == NULL ||
+      width < 0 || pitch < 0 || height < 0 || pixelFormat < 0 ||
+      pixelFormat >= TJ_NUMPF)
+    THROW("tjDecompressPreview(): Invalid argument");
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  setDecompProgress(this, &progress, flags);
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  jpeg_read_header(dinfo, TRUE);
+  checkLimits(this, TRUE);
+  this->dinfo.out_color_space = pf2cs[pixelFormat];
+  if (flags & TJFLAG_FASTDCT) this->dinfo.dct_method = JDCT_FASTEST;
+  else if (flags & TJFLAG_AUTODCT) this->dinfo.dct_method = JDCT_AUTO;
+  if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+
+  jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
+  if (width == 0) width = jpegwidth;
+  if (height == 0) height = jpegheight;
+  for (i = 0; i < NUMSF; i++) {
+    scaledw = TJSCALED(jpegwidth, sf[i]);
+    scaledh = TJSCALED(jpegheight, sf[i]);
+    if (scaledw <= width && scaledh <= height)
+      break;
+  }
+  if (i >= NUMSF)
+    THROW("tjDecompressPreview(): Could not scale down to desired image dimensions");
+  width = scaledw;  height = scaledh;
+  dinfo->scale_num = sf[i].num;
+  dinfo->scale_denom = sf[i].denom;
+
+  /* Use buffered-image mode so that we can emit an output pass after the
+   * desired number of scans and never read the rest of the JPEG image.
+   */
+  dinfo->buffered_image = TRUE;
+  jpeg_start_decompress(dinfo);
+  if (pitch == 0) pitch = dinfo->output_width * tjPixelSize[pixelFormat];
+
+  /* Absorb input until the requested number of scans have been read in full,
+   * i.e. until the SOS marker of the following scan is reached, or until the
+   * end of the available data.  (The memory source manager never suspends.
+   * If the data are truncated, then it inserts a fake EOI marker.)
+   */
+  do {
+    status = jpeg_consume_input(dinfo);
+  } while (status != JPEG_REACHED_EOI && status != JPEG_SUSPENDED &&
+           (numScans == 0 || dinfo->input_scan_number <= numScans));
+  scan = dinfo->input_scan_number;
+  if (numScans > 0 && scan > numScans) scan = numScans;
+
+  jpeg_start_output(dinfo, scan);
+
+  if ((row_pointer =
+       (JSAMPROW *)malloc(sizeof(JSAMPROW) * dinfo->output_height)) == NULL)
+    THROW("tjDecompressPreview(): Memory allocation failure");
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+  for (i = 0; i < (int)dinfo->output_height; i++) {
+    if (flags & TJFLAG_BOTTOMUP)
+      row_pointer[i] = &dstBuf[(dinfo->output_height - i - 1) * (size_t)pitch];
+    else
+      row_pointer[i] = &dstBuf[i * (size_t)pitch];
+  }
+  while (dinfo->output_scanline < dinfo->output_height)
+    jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline],
+                        dinfo->output_height - dinfo->output_scanline);
+  jpeg_finish_output(dinfo);
+  /* The rest of the JPEG image, if any, is discarded by
+     jpeg_abort_decompress() below. */
+
+bailout:
+  dinfo->progress = NULL;
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  free(row_pointer);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
+/* Compute a 64-bit perceptual hash from an 8-bit grayscale image:  reduce the
+   image to 32x32 using box filtering, compute the 8x8 lowest-frequency
+   coefficients of its 2D DCT-II, and set each bit if the corresponding
+   coefficient is greater than the median of the 63 AC coefficients. */
+
+#define HASH_SIZE  32
+
+static void computeDCTHash(const unsigned char *gray, int width, int height,
+                           unsigned char *hash)
+{
+  double small[HASH_SIZE][HASH_SIZE], tmp[8][HASH_SIZE], coef[DCTSIZE2],
+    sorted[DCTSIZE2 - 1], cosTable[4 * HASH_SIZE], median;
+  int x, y, u, v, i, j;
+
+  for (y = 0; y < HASH_SIZE; y++) {
+    int y0 = y * height / HASH_SIZE, y1 = (y + 1) * height / HASH_SIZE;
+
+    if (y1 <= y0) y1 = y0 + 1;
+    for (x = 0; x < HASH_SIZE; x++) {
+      int x0 = x * width / HASH_SIZE, x1 = (x + 1) * width / HASH_SIZE, xx,
+        yy;
+      double sum = 0.;
+
+      if (x1 <= x0) x1 = x0 + 1;
+      for (yy = y0; yy < y1; yy++)
+        for (xx = x0; xx < x1; xx++)
+          sum += gray[yy * (size_t)width + xx];
+      small[y][x] = sum / (double)((y1 - y0) * (x1 - x0));
+    }
+  }
+
+  /* cosTable[k] = cos(k * PI / 64), generated using the Chebyshev recurrence
+     so that libturbojpeg need not depend on libm */
+  cosTable[0] = 1.;
+  cosTable[1] = 0.99879545620517239271;
+  for (i = 2; i < 4 * HASH_SIZE; i++)
+    cosTable[i] = 2. * cosTable[1] * cosTable[i - 1] - cosTable[i - 2];
+
+  for (u = 0; u < 8; u++) {
+    for (x = 0; x < HASH_SIZE; x++) {
+      double sum = 0.;
+
+      for (y = 0; y < HASH_SIZE; y++)
+        sum += small[y][x] * cosTable[((2 * y + 1) * u) % (4 * HASH_SIZE)];
+      tmp[u][x] = sum;
+    }
+  }
+  for (u = 0; u < 8; u++) {
+    for (v = 0; v < 8; v++) {
+      double sum = 0.;
+
+      for (x = 0; x < HASH_SIZE; x++)
+        sum += tmp[u][x] * cosTable[((2 * x + 1) * v) % (4 * HASH_SIZE)];
+      coef[u * 8 + v] = sum;
+    }
+  }
+
+  /* Insertion sort is more than adequate for 63 values. */
+  for (i = 1; i < DCTSIZE2; i++) {
+    double val = coef[i];
+
+    for (j = i - 1; j > 0 && sorted[j - 1] > val; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = val;
+  }
+  median = sorted[(DCTSIZE2 - 1) / 2];
+
+  MEMZERO(hash, 8);
+  for (i = 0; i < DCTSIZE2; i++) {
+    if (coef[i] > median)
+      hash[i / 8] |= (unsigned char)(0x80 >> (i % 8));
+  }
+}
+
+
+DLLEXPORT int tjDecompressDC(tjhandle handle, const unsigned char *jpegBuf,
+                             unsigned long jpegSize, unsigned char *dstBuf,
+                             int pitch, tjdcsummary *summary, int flags)
+{
+  JSAMPLE *planes[MAX_COMPONENTS];
+  JSAMPROW *rows[MAX_COMPONENTS];
+  unsigned char *gray = NULL;
+  int retval = 0, width, height, x, y, ci, refci = 0, row, pw[MAX_COMPONENTS],
+    ph[MAX_COMPONENTS];
+  double sum[3] = { 0., 0., 0. };
+  struct my_progress_mgr progress;
+
+  GET_DINSTANCE(handle);
+  for (ci = 0; ci < MAX_COMPONENTS; ci++) {
+    planes[ci] = NULL;  rows[ci] = NULL;
+  }
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressDC(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || pitch < 0 ||
+      (dstBuf == NULL && summary == NULL))
+    THROW("tjDecompressDC(): Invalid argument");
+
+  setDecompProgress(this, &progress, flags);
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  jpeg_read_header(dinfo, TRUE);
+  checkLimits(this, FALSE);
+  if (dinfo->jpeg_color_space != JCS_GRAYSCALE &&
+      dinfo->jpeg_color_space != JCS_YCbCr &&
+      dinfo->jpeg_color_space != JCS_RGB)
+    THROW("tjDecompressDC(): Unsupported color space");
+
+  /* With 1/8 scaling, libjpeg uses a 1x1 "IDCT", which merely dequantizes and
+     level-shifts the DC coefficient, and the Huffman decoder skips the AC
+     coefficients rather than storing them.  Raw data output bypasses
+     upsampling and color conversion. */
+  dinfo->scale_num = 1;
+  dinfo->scale_denom = 8;
+  dinfo->raw_data_out = TRUE;
+  jpeg_start_decompress(dinfo);
+  width = dinfo->output_width;  height = dinfo->output_height;
+  if (pitch == 0) pitch = width;
+
+  for (ci = 0; ci < dinfo->num_components; ci++) {
+    jpeg_component_info *compptr = &dinfo->comp_info[ci];
+
+    if (compptr->h_samp_factor == dinfo->max_h_samp_factor) refci = ci;
+    pw[ci] = (compptr->width_in_blocks + compptr->h_samp_factor - 1) /
+             compptr->h_samp_factor * compptr->h_samp_factor;
+    ph[ci] = dinfo->total_iMCU_rows * compptr->v_samp_factor;
+    if ((planes[ci] = (JSAMPLE *)malloc((size_t)pw[ci] * ph[ci])) == NULL ||
+        (rows[ci] = (JSAMPROW *)malloc(sizeof(JSAMPROW) * ph[ci])) == NULL)
+      THROW("tjDecompressDC(): Memory allocation failure");
+    for (row = 0; row < ph[ci]; row++)
+      rows[ci][row] = &planes[ci][row * (size_t)pw[ci]];
+  }
+  if ((gray = (unsigned char *)malloc((size_t)width * height)) == NULL)
+    THROW("tjDecompressDC(): Memory allocation failure");
+
+  for (row = 0; row < (int)dinfo->total_iMCU_rows; row++) {
+    JSAMPARRAY planeptr[MAX_COMPONENTS];
+
+    for (ci = 0; ci < dinfo->num_components; ci++) {
+      jpeg_component_info *compptr = &dinfo->comp_info[ci];
+
+      if (compptr->_DCT_scaled_size != 1) {
+        /* Prevent libjpeg from using the IDCT to upsample a subsampled
+           component (see tjDecompressToYUVPlanes().) */
+        compptr->_DCT_scaled_size = 1;
+        compptr->MCU_sample_width = compptr->MCU_width;
+        dinfo->idct->inverse_DCT[ci] = dinfo->idct->inverse_DCT[refci];
+      }
+      planeptr[ci] = &rows[ci][row * compptr->v_samp_factor];
+    }
+    jpeg_read_raw_data(dinfo, planeptr, dinfo->max_v_samp_factor);
+  }
+
+  for (y = 0; y < height; y++) {
+    JSAMPROW inrow[MAX_COMPONENTS];
+
+    for (ci = 0; ci < dinfo->num_components; ci++) {
+      jpeg_component_info *compptr = &dinfo->comp_info[ci];
+      int cy = y * compptr->v_samp_factor / dinfo->max_v_samp_factor;
+
+      inrow[ci] = rows[ci][MIN(cy, (int)compptr->height_in_blocks - 1)];
+    }
+
+    for (x = 0; x < width; x++) {
+      int c[MAX_COMPONENTS], r, g, b, luma, weight;
+
+      for (ci = 0; ci < dinfo->num_components; ci++) {
+        jpeg_component_info *compptr = &dinfo->comp_info[ci];
+        int cx = x * compptr->h_samp_factor / dinfo->max_h_samp_factor;
+
+        c[ci] = inrow[ci][MIN(cx, (int)compptr->width_in_blocks - 1)];
+      }
+
+      if (dinfo->jpeg_color_space == JCS_GRAYSCALE) {
+        r = g = b = luma = c[0];
+      } else if (dinfo->jpeg_color_space == JCS_YCbCr) {
+        int cb = c[1] - CENTERJSAMPLE, cr = c[2] - CENTERJSAMPLE;
+
+        luma = c[0];
+        r = c[0] + ((91881 * cr + 32768) >> 16);
+        g = c[0] + ((-22554 * cb - 46802 * cr + 32768) >> 16);
+        b = c[0] + ((116130 * cb + 32768) >> 16);
+        r = MIN(MAX(r, 0), MAXJSAMPLE);
+        g = MIN(MAX(g, 0), MAXJSAMPLE);
+        b = MIN(MAX(b, 0), MAXJSAMPLE);
+      } else {
+        r = c[0];  g = c[1];  b = c[2];
+        luma = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+      }
+      gray[y * (size_t)width + x] = (unsigned char)luma;
+      /* Blocks at the right and bottom edges may only partially cover the
+         image. */
+      weight = MIN((int)dinfo->image_width - x * DCTSIZE, DCTSIZE) *
+               MIN((int)dinfo->image_height - y * DCTSIZE, DCTSIZE);
+      sum[0] += (double)r * weight;  sum[1] += (double)g * weight;
+      sum[2] += (double)b * weight;
+    }
+  }
+  jpeg_finish_decompress(dinfo);
+
+  if (dstBuf) {
+    for (y = 0; y < height; y++) {
+      int dsty = (flags & TJFLAG_BOTTOMUP) ? height - y - 1 : y;
+
+      memcpy(&dstBuf[dsty * (size_t)pitch], &gray[y * (size_t)width], width);
+    }
+  }
+  if (summary) {
+    double n = (double)dinfo->image_width * dinfo->image_height;
+
+    for (ci = 0; ci < 3; ci++)
+      summary->avgColor[ci] = (unsigned char)(sum[ci] / n + 0.5);
+    computeDCTHash(gray, width, height, summary->hash);
+  }
+
+bailout:
+  dinfo->progress = NULL;
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  for (ci = 0; ci < MAX_COMPONENTS; ci++) {
+    free(planes[ci]);
+    free(rows[ci]);
+  }
+  free(gray);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+DLLEXPORT int tjDecompress(tjhandle handle, unsigned char *jpegBuf,
+                           unsigned long jpegSize, unsigned char *dstBuf,
+                           int width, int pitch, int height, int pixelSize,
+                           int flags)
+{
+  if (flags & TJ_YUV)
+    return tjDecompressToYUV(handle, jpegBuf, jpegSize, dstBuf, flags);
+  else
+    return tjDecompress2(handle, jpegBuf, jpegSize, dstBuf, width, pitch,
+                         height, getPixelFormat(pixelSize, flags), flags);
+}
+
+
+static int setDecodeDefaults(struct jpeg_decompress_struct *dinfo,
+                             int pixelFormat, int subsamp, int flags)
+{
+  int i;
+
+  dinfo->scale_num = dinfo->scale_denom = 1;
+
+  if (subsamp == TJSAMP_GRAY) {
+    dinfo->num_components = dinfo->comps_in_scan = 1;
+    dinfo->jpeg_color_space = JCS_GRAYSCALE;
+  } else {
+    dinfo->num_components = dinfo->comps_in_scan = 3;
+    dinfo->jpeg_color_space = JCS_YCbCr;
+  }
+
+  dinfo->comp_info = (jpeg_component_info *)
+    (*dinfo->mem->alloc_small) ((j_common_ptr)dinfo, JPOOL_IMAGE,
+                                dinfo->num_components *
+                                sizeof(jpeg_component_info));
+
+  for (i = 0; i < dinfo->num_components; i++) {
+    jpeg_component_info *compptr = &dinfo->comp_info[i];
+
+    compptr->h_samp_factor = (i == 0) ? tjMCUWidth[subsamp] / 8 : 1;
+    compptr->v_samp_factor = (i == 0) ? tjMCUHeight[subsamp] / 8 : 1;
+    compptr->component_index = i;
+    compptr->component_id = i + 1;
+    compptr->quant_tbl_no = compptr->dc_tbl_no =
+      compptr->ac_tbl_no = (i == 0) ? 0 : 1;
+    dinfo->cur_comp_info[i] = compptr;
+  }
+  dinfo->data_precision = 8;
+  for (i = 0; i < 2; i++) {
+    if (dinfo->quant_tbl_ptrs[i] == NULL)
+      dinfo->quant_tbl_ptrs[i] = jpeg_alloc_quant_table((j_common_ptr)dinfo);
+  }
+
+  return 0;
+}
+
+
+static int my_read_markers(j_decompress_ptr dinfo)
+{
+  return JPEG_REACHED_SOS;
+}
+
+static void my_reset_marker_reader(j_decompress_ptr dinfo)
+{
+}
 
 DLLEXPORT int tjDecodeYUVPlanes(tjhandle handle,
                                 const unsigned char **srcPlanes,
@@ -1491,6 +2520,7 @@ DLLEXPORT int tjDecodeYUVPlanes(tjhandle handle,
 
   this->dinfo.out_color_space = pf2cs[pixelFormat];
   if (flags & TJFLAG_FASTDCT) this->dinfo.dct_method = JDCT_FASTEST;
+  else if (flags & TJFLAG_AUTODCT) this->dinfo.dct_method = JDCT_AUTO;
   dinfo->do_fancy_upsampling = FALSE;
   dinfo->Se = DCTSIZE2 - 1;
   jinit_master_decompress(dinfo);
@@ -1621,7 +2651,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
   int i, sfi, row, retval = 0;
   int jpegwidth, jpegheight, jpegSubsamp, scaledw, scaledh;
   int pw[MAX_COMPONENTS], ph[MAX_COMPONENTS], iw[MAX_COMPONENTS],
-    tmpbufsize = 0, usetmpbuf = 0, th[MAX_COMPONENTS];
+    tmpbufsize = 0, usetmpbuf = 0, padwidth = 0, th[MAX_COMPONENTS];
   JSAMPLE *_tmpbuf = NULL, *ptr;
   JSAMPROW *outbuf[MAX_COMPONENTS], *tmpbuf[MAX_COMPONENTS];
   int dctsize;
@@ -1647,13 +2677,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
   else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
 #endif
 
-  if (flags & TJFLAG_LIMITSCANS) {
-    MEMZERO(&progress, sizeof(struct my_progress_mgr));
-    progress.pub.progress_monitor = my_progress_monitor;
-    progress.this = this;
-    dinfo->progress = &progress.pub;
-  } else
-    dinfo->progress = NULL;
+  setDecompProgress(this, &progress, flags);
 
   if (setjmp(this->jerr.setjmp_buffer)) {
     /* If we get here, the JPEG code has signaled an error. */
@@ -1665,6 +2689,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
     jpeg_read_header(dinfo, TRUE);
   }
   this->headerRead = 0;
+  checkLimits(this, FALSE);
   jpegSubsamp = getSubsamp(dinfo);
   if (jpegSubsamp < 0)
     THROW("tjDecompressToYUVPlanes(): Could not determine subsampling type for JPEG image");
@@ -1702,6 +2727,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
     ih = compptr->height_in_blocks * dctsize;
     pw[i] = tjPlaneWidth(i, dinfo->output_width, jpegSubsamp);
     ph[i] = tjPlaneHeight(i, dinfo->output_height, jpegSubsamp);
+    if (iw[i] != pw[i]) padwidth = 1;
     if (iw[i] != pw[i] || ih != ph[i]) usetmpbuf = 1;
     th[i] = compptr->v_samp_factor * dctsize;
     tmpbufsize += iw[i] * th[i];
@@ -1734,13 +2760,14 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
 
   if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
   if (flags & TJFLAG_FASTDCT) dinfo->dct_method = JDCT_FASTEST;
+  else if (flags & TJFLAG_AUTODCT) dinfo->dct_method = JDCT_AUTO;
   dinfo->raw_data_out = TRUE;
 
   jpeg_start_decompress(dinfo);
   for (row = 0; row < (int)dinfo->output_height;
        row += dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size) {
     JSAMPARRAY yuvptr[MAX_COMPONENTS];
-    int crow[MAX_COMPONENTS];
+    int crow[MAX_COMPONENTS], copyrows = padwidth;
 
     for (i = 0; i < dinfo->num_components; i++) {
       jpeg_component_info *compptr = &dinfo->comp_info[i];
@@ -1763,12 +2790,17 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
         dinfo->idct->inverse_DCT[i] = dinfo->idct->inverse_DCT[0];
       }
       crow[i] = row * compptr->v_samp_factor / dinfo->max_v_samp_factor;
-      if (usetmpbuf) yuvptr[i] = tmpbuf[i];
+      if (crow[i] + th[i] > ph[i]) copyrows = 1;
+    }
+    /* Decompress directly into the destination planes unless the iMCU row
+       extends past the right or bottom edge of a plane. */
+    for (i = 0; i < dinfo->num_components; i++) {
+      if (copyrows) yuvptr[i] = tmpbuf[i];
       else yuvptr[i] = &outbuf[i][crow[i]];
     }
     jpeg_read_raw_data(dinfo, yuvptr,
                        dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size);
-    if (usetmpbuf) {
+    if (copyrows) {
       int j;
 
       for (i = 0; i < dinfo->num_components; i++) {
@@ -1781,6 +2813,7 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
   jpeg_finish_decompress(dinfo);
 
 bailout:
+  dinfo->progress = NULL;
   if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
   for (i = 0; i < MAX_COMPONENTS; i++) {
     free(tmpbuf[i]);
@@ -1792,6 +2825,156 @@ bailout:
   return retval;
 }
 
+
+DLLEXPORT int tjDecompressToYUVRows(tjhandle handle,
+                                    const unsigned char *jpegBuf,
+                                    unsigned long jpegSize, int width,
+                                    int height,
+                                    int (*rowHandler) (const unsigned char **,
+                                                       const int *,
+                                                       const tjregion *, int,
+                                                       void *),
+                                    void *data, int flags)
+{
+  int i, sfi, row, retval = 0;
+  int jpegwidth, jpegheight, jpegSubsamp, scaledw, scaledh;
+  int pw[MAX_COMPONENTS], ph[MAX_COMPONENTS], iw[MAX_COMPONENTS],
+    th[MAX_COMPONENTS], rowbufsize = 0;
+  JSAMPLE *_rowbuf = NULL, *ptr;
+  JSAMPROW *rowbuf[MAX_COMPONENTS];
+  int dctsize;
+  struct my_progress_mgr progress;
+
+  GET_DINSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+
+  for (i = 0; i < MAX_COMPONENTS; i++) rowbuf[i] = NULL;
+
+  if ((this->init & DECOMPRESS) == 0)
+    THROW("tjDecompressToYUVRows(): Instance has not been initialized for decompression");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || width < 0 || height < 0 ||
+      rowHandler == NULL)
+    THROW("tjDecompressToYUVRows(): Invalid argument");
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  setDecompProgress(this, &progress, flags);
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  jpeg_read_header(dinfo, TRUE);
+  checkLimits(this, FALSE);
+  jpegSubsamp = getSubsamp(dinfo);
+  if (jpegSubsamp < 0)
+    THROW("tjDecompressToYUVRows(): Could not determine subsampling type for JPEG image");
+
+  jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
+  if (width == 0) width = jpegwidth;
+  if (height == 0) height = jpegheight;
+  for (i = 0; i < NUMSF; i++) {
+    scaledw = TJSCALED(jpegwidth, sf[i]);
+    scaledh = TJSCALED(jpegheight, sf[i]);
+    if (scaledw <= width && scaledh <= height)
+      break;
+  }
+  if (i >= NUMSF)
+    THROW("tjDecompressToYUVRows(): Could not scale down to desired image dimensions");
+  if (dinfo->num_components > 3)
+    THROW("tjDecompressToYUVRows(): JPEG image must have 3 or fewer components");
+
+  dinfo->scale_num = sf[i].num;
+  dinfo->scale_denom = sf[i].denom;
+  sfi = i;
+  jpeg_calc_output_dimensions(dinfo);
+
+  dctsize = DCTSIZE * sf[sfi].num / sf[sfi].denom;
+
+  /* Allocate one iMCU row for each component.  The IDCT writes into these
+     buffers, and the row handler reads from them, so no copy is needed. */
+  for (i = 0; i < dinfo->num_components; i++) {
+    jpeg_component_info *compptr = &dinfo->comp_info[i];
+
+    iw[i] = compptr->width_in_blocks * dctsize;
+    pw[i] = tjPlaneWidth(i, dinfo->output_width, jpegSubsamp);
+    ph[i] = tjPlaneHeight(i, dinfo->output_height, jpegSubsamp);
+    th[i] = compptr->v_samp_factor * dctsize;
+    rowbufsize += iw[i] * th[i];
+  }
+  if ((_rowbuf = (JSAMPLE *)malloc(sizeof(JSAMPLE) * rowbufsize)) == NULL)
+    THROW("tjDecompressToYUVRows(): Memory allocation failure");
+  ptr = _rowbuf;
+  for (i = 0; i < dinfo->num_components; i++) {
+    if ((rowbuf[i] = (JSAMPROW *)malloc(sizeof(JSAMPROW) * th[i])) == NULL)
+      THROW("tjDecompressToYUVRows(): Memory allocation failure");
+    for (row = 0; row < th[i]; row++) {
+      rowbuf[i][row] = ptr;
+      ptr += iw[i];
+    }
+  }
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+  if (flags & TJFLAG_FASTDCT) dinfo->dct_method = JDCT_FASTEST;
+  else if (flags & TJFLAG_AUTODCT) dinfo->dct_method = JDCT_AUTO;
+  dinfo->raw_data_out = TRUE;
+
+  jpeg_start_decompress(dinfo);
+  for (row = 0; row < (int)dinfo->output_height;
+       row += dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size) {
+    const unsigned char *planes[MAX_COMPONENTS];
+    int strides[MAX_COMPONENTS];
+    tjregion regions[MAX_COMPONENTS];
+
+    for (i = 0; i < dinfo->num_components; i++) {
+      jpeg_component_info *compptr = &dinfo->comp_info[i];
+
+      if (jpegSubsamp == TJ_420) {
+        /* Force libjpeg to use the "scaled" IDCT functions on the U and V
+           planes (see tjDecompressToYUVPlanes().) */
+        compptr->_DCT_scaled_size = dctsize;
+        compptr->MCU_sample_width = tjMCUWidth[jpegSubsamp] *
+          sf[sfi].num / sf[sfi].denom *
+          compptr->v_samp_factor / dinfo->max_v_samp_factor;
+        dinfo->idct->inverse_DCT[i] = dinfo->idct->inverse_DCT[0];
+      }
+      planes[i] = rowbuf[i][0];
+      strides[i] = iw[i];
+      regions[i].x = 0;
+      regions[i].y = row * compptr->v_samp_factor / dinfo->max_v_samp_factor;
+      regions[i].w = pw[i];
+      regions[i].h = MIN(th[i], ph[i] - regions[i].y);
+    }
+    jpeg_read_raw_data(dinfo, rowbuf,
+                       dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size);
+    if (rowHandler(planes, strides, regions, dinfo->num_components,
+                   data) == -1)
+      THROW("tjDecompressToYUVRows(): Error in row handler");
+  }
+  jpeg_finish_decompress(dinfo);
+
+bailout:
+  dinfo->progress = NULL;
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  for (i = 0; i < MAX_COMPONENTS; i++) free(rowbuf[i]);
+  free(_rowbuf);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
 DLLEXPORT int tjDecompressToYUV2(tjhandle handle, const unsigned char *jpegBuf,
                                  unsigned long jpegSize, unsigned char *dstBuf,
                                  int width, int pad, int height, int flags)
@@ -1910,13 +3093,8 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
   else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
 #endif
 
-  if (flags & TJFLAG_LIMITSCANS) {
-    MEMZERO(&progress, sizeof(struct my_progress_mgr));
-    progress.pub.progress_monitor = my_progress_monitor;
-    progress.this = this;
-    dinfo->progress = &progress.pub;
-  } else
-    dinfo->progress = NULL;
+  setDecompProgress(this, &progress, flags);
+  cinfo->progress = &progress.pub;
 
   if ((xinfo =
        (jpeg_transform_info *)malloc(sizeof(jpeg_transform_info) * n)) == NULL)
@@ -1956,6 +3134,7 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
 
   jcopy_markers_setup(dinfo, saveMarkers ? JCOPYOPT_ALL : JCOPYOPT_NONE);
   jpeg_read_header(dinfo, TRUE);
+  checkLimits(this, TRUE);
   jpegSubsamp = getSubsamp(dinfo);
   if (jpegSubsamp < 0)
     THROW("tjTransform(): Could not determine subsampling type for JPEG image");
@@ -2038,6 +3217,8 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
   jpeg_finish_decompress(dinfo);
 
 bailout:
+  dinfo->progress = NULL;
+  cinfo->progress = NULL;
   if (cinfo->global_state > CSTATE_START) {
     if (alloc) (*cinfo->dest->term_destination) (cinfo);
     jpeg_abort_compress(cinfo);
@@ -2050,6 +3231,150 @@ bailout:
 }
 
 
+DLLEXPORT int tjTranscode(tjhandle handle, const unsigned char *jpegBuf,
+                          unsigned long jpegSize, int width, int height,
+                          unsigned char **dstBuf, unsigned long *dstSize,
+                          int jpegSubsamp, int jpegQual, int flags)
+{
+  JSAMPARRAY buffer;
+  JDIMENSION nrows, bufrows;
+  int i, retval = 0, alloc = 1, pixelFormat;
+  int jpegwidth, jpegheight, scaledw, scaledh;
+  struct my_progress_mgr progress;
+
+  GET_INSTANCE(handle);
+  this->jerr.stopOnWarning = (flags & TJFLAG_STOPONWARNING) ? TRUE : FALSE;
+  if ((this->init & COMPRESS) == 0 || (this->init & DECOMPRESS) == 0)
+    THROW("tjTranscode(): Instance has not been initialized for transformation");
+
+  if (jpegBuf == NULL || jpegSize <= 0 || width < 0 || height < 0 ||
+      dstBuf == NULL || dstSize == NULL || jpegSubsamp < -1 ||
+      jpegSubsamp >= NUMSUBOPT || jpegQual < -1 || jpegQual > 100)
+    THROW("tjTranscode(): Invalid argument");
+
+#ifndef NO_PUTENV
+  if (flags & TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+  else if (flags & TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+  else if (flags & TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+#endif
+
+  setDecompProgress(this, &progress, flags);
+  cinfo->progress = &progress.pub;
+
+  if (setjmp(this->jerr.setjmp_buffer)) {
+    /* If we get here, the JPEG code has signaled an error. */
+    retval = -1;  goto bailout;
+  }
+
+  jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+  jpeg_read_header(dinfo, TRUE);
+  checkLimits(this, FALSE);
+  if (jpegSubsamp < 0) {
+    jpegSubsamp = getSubsamp(dinfo);
+    if (jpegSubsamp < 0)
+      THROW("tjTranscode(): Could not determine subsampling type for JPEG image");
+  }
+
+  /* Hand off the samples in the JPEG image's native colorspace whenever
+     possible, so that the decompressor's color deconverter and the
+     compressor's color converter both reduce to a plain copy. */
+  if (jpegSubsamp == TJSAMP_GRAY) {
+    dinfo->out_color_space = JCS_GRAYSCALE;
+    pixelFormat = TJPF_GRAY;
+  } else if (dinfo->jpeg_color_space == JCS_CMYK ||
+             dinfo->jpeg_color_space == JCS_YCCK) {
+    dinfo->out_color_space = dinfo->jpeg_color_space;
+    pixelFormat = TJPF_CMYK;
+  } else if (dinfo->jpeg_color_space == JCS_YCbCr ||
+             dinfo->jpeg_color_space == JCS_RGB) {
+    dinfo->out_color_space = dinfo->jpeg_color_space;
+    pixelFormat = TJPF_RGB;
+  } else
+    THROW("tjTranscode(): Unsupported JPEG colorspace");
+  if (flags & TJFLAG_FASTDCT) dinfo->dct_method = JDCT_FASTEST;
+  else if (flags & TJFLAG_AUTODCT) dinfo->dct_method = JDCT_AUTO;
+  if (flags & TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling = FALSE;
+
+  jpegwidth = dinfo->image_width;  jpegheight = dinfo->image_height;
+  if (width == 0) width = jpegwidth;
+  if (height == 0) height = jpegheight;
+  for (i = 0; i < NUMSF; i++) {
+    scaledw = TJSCALED(jpegwidth, sf[i]);
+    scaledh = TJSCALED(jpegheight, sf[i]);
+    if (scaledw <= width && scaledh <= height)
+      break;
+  }
+  if (i >= NUMSF)
+    THROW("tjTranscode(): Could not scale down to desired image dimensions");
+  dinfo->scale_num = sf[i].num;
+  dinfo->scale_denom = sf[i].denom;
+
+  jpeg_start_decompress(dinfo);
+
+  cinfo->image_width = dinfo->output_width;
+  cinfo->image_height = dinfo->output_height;
+  if (flags & TJFLAG_NOREALLOC) {
+    alloc = 0;
+    *dstSize = tjBufSize(cinfo->image_width, cinfo->image_height,
+                         jpegSubsamp);
+  }
+  jpeg_mem_dest_tj(cinfo, dstBuf, dstSize, alloc);
+  setCompDefaults(cinfo, pixelFormat, jpegSubsamp, jpegQual, flags);
+  cinfo->in_color_space = dinfo->out_color_space;
+
+  if (jpegQual < 0) {
+    /* Pass the source quantization tables through to the destination image,
+       slot by slot, and assign them to the components as the source image
+       does.  (The source image may use separate tables for Cb and Cr, which
+       setCompDefaults() assigns to the same slot.) */
+    for (i = 0; i < NUM_QUANT_TBLS; i++) {
+      JQUANT_TBL *srctbl = dinfo->quant_tbl_ptrs[i];
+
+      if (srctbl == NULL) continue;
+      if (cinfo->quant_tbl_ptrs[i] == NULL)
+        cinfo->quant_tbl_ptrs[i] = jpeg_alloc_quant_table((j_common_ptr)cinfo);
+      MEMCOPY(cinfo->quant_tbl_ptrs[i]->quantval, srctbl->quantval,
+              sizeof(srctbl->quantval));
+    }
+    for (i = 0; i < cinfo->num_components && i < dinfo->num_components;
+         i++) {
+      if (dinfo->quant_tbl_ptrs[dinfo->comp_info[i].quant_tbl_no] != NULL)
+        cinfo->comp_info[i].quant_tbl_no = dinfo->comp_info[i].quant_tbl_no;
+    }
+    if (flags & TJFLAG_FASTDCT) cinfo->dct_method = JDCT_FASTEST;
+  }
+
+  jpeg_start_compress(cinfo, TRUE);
+  if (flags & TJFLAG_BLOCKCACHE)
+    jinit_fdct_block_cache(cinfo, &this->blockCache);
+
+  /* One iMCU row of decompressed output is all we ever need to hold. */
+  bufrows = dinfo->max_v_samp_factor * dinfo->_min_DCT_scaled_size;
+  buffer = (*dinfo->mem->alloc_sarray)
+    ((j_common_ptr)dinfo, JPOOL_IMAGE,
+     dinfo->output_width * dinfo->output_components, bufrows);
+
+  while (dinfo->output_scanline < dinfo->output_height) {
+    nrows = jpeg_read_scanlines(dinfo, buffer, bufrows);
+    jpeg_write_scanlines(cinfo, buffer, nrows);
+  }
+  jpeg_finish_compress(cinfo);
+  jpeg_finish_decompress(dinfo);
+
+bailout:
+  dinfo->progress = NULL;
+  cinfo->progress = NULL;
+  if (cinfo->global_state > CSTATE_START) {
+    if (alloc) (*cinfo->dest->term_destination) (cinfo);
+    jpeg_abort_compress(cinfo);
+  }
+  if (dinfo->global_state > DSTATE_START) jpeg_abort_decompress(dinfo);
+  if (this->jerr.warning) retval = -1;
+  this->jerr.stopOnWarning = FALSE;
+  return retval;
+}
+
+
 DLLEXPORT unsigned char *tjLoadImage(const char *filename, int *width,
                                      int align, int *height, int *pixelFormat,
                                      int flags)
@@ -429,12 +429,46 @@ enum TJCS {
  * <a href="https://libjpeg-turbo.org/pmwiki/uploads/About/TwoIssueswiththeJPEGStandard.pdf" target="_blank">this report</a>.
  */
 #define TJFLAG_LIMITSCANS  32768
+/**
+ * When compressing, remember the quantized DCT coefficients of recently
+ * encoded 8x8 blocks, and reuse them for identical blocks in the same image or
+ * in subsequent images compressed with the same TurboJPEG instance.  This
+ * speeds up the compression of screen content and other images that contain
+ * many repeated blocks.  It does not change the compressed output.  The cache
+ * requires about 200 KB of memory per quantization table, and that memory is
+ * retained until the TurboJPEG instance is destroyed.
+ */
+#define TJFLAG_BLOCKCACHE  65536
+/**
+ * Compress successive images (such as desktop or video frames) incrementally.
+ * When this flag is passed to #tjCompress2(), the JPEG image is generated with
+ * one restart interval per MCU row, and the TurboJPEG instance retains a copy
+ * of the source image along with the entropy-coded data for each restart
+ * interval.  If the next image passed to #tjCompress2() with this flag has the
+ * same dimensions, pixel format, subsampling, and quality, then only the MCU
+ * rows that have changed are re-encoded, and the entropy-coded data for the
+ * other MCU rows is reused.  The resulting JPEG image is identical to the one
+ * that would have been generated had the image been compressed in full.  This
+ * flag is ignored when generating progressive JPEG images.
+ */
+#define TJFLAG_INCREMENTAL  131072
+/**
+ * When decompressing, choose the IDCT algorithm separately for each component
+ * based on its quantization table.  The fast algorithm is used for components
+ * whose quantization table entries average 16 or more (with the standard
+ * tables, this corresponds to a JPEG quality of about 86 or below for
+ * luminance and about 90 or below for chrominance), since the additional error
+ * that it introduces is small relative to the quantization error in that case.
+ * The accurate algorithm is used for all other components.  This flag is
+ * ignored when compressing and if #TJFLAG_FASTDCT is also specified.
+ */
+#define TJFLAG_AUTODCT  262144
 
 
 /**
  * The number of error codes
  */
-#define TJ_NUMERR  2
+#define TJ_NUMERR  3
 
 /**
  * Error codes
@@ -448,7 +482,12 @@ enum TJERR {
   /**
    * The error was fatal and non-recoverable.
    */
-  TJERR_FATAL
+  TJERR_FATAL,
+  /**
+   * The operation was cancelled with #tjCancel(), or it exceeded the time
+   * limit set with #tjSetTimeout().
+   */
+  TJERR_ABORTED
 };
 
 
@@ -656,6 +695,65 @@ typedef struct tjtransform {
                        int transformIndex, struct tjtransform *transform);
 } tjtransform;
 
+
+/**
+ * Summary of a JPEG image computed from its DC coefficients (see
+ * #tjDecompressDC().)
+ */
+typedef struct {
+  /**
+   * The average color of the image, as red, green, and blue components
+   */
+  unsigned char avgColor[3];
+  /**
+   * 64-bit DCT-based perceptual hash of the image's luminance, most
+   * significant bit first.  Images that look alike (for instance, the same
+   * image compressed with different quality levels) have hashes that differ
+   * in only a few bits, so the Hamming distance between two hashes can be
+   * used to detect near-duplicate images.
+   */
+  unsigned char hash[8];
+} tjdcsummary;
+
+
+/**
+ * Resource limits for decompression and transform operations (see
+ * #tjSetLimits().)  A value of 0 for any field means "no limit."
+ */
+typedef struct {
+  /**
+   * The maximum number of pixels (width * height) in a JPEG image that will
+   * be decompressed or transformed
+   */
+  unsigned long maxPixels;
+  /**
+   * The maximum size (in bytes) of the buffer that holds the DCT coefficients
+   * for the whole image.  Such a buffer is needed when decompressing
+   * progressive and other multi-scan JPEG images, when generating previews
+   * with #tjDecompressPreview(), and when transforming JPEG images.  The size
+   * is 128 bytes per 8x8 block (about 256 bytes per pixel for 4:4:4 images or
+   * 192 bytes per pixel for 4:2:0 images) and is computed from the JPEG
+   * header before any buffers are allocated.
+   */
+  unsigned long maxCoefMemory;
+  /**
+   * The maximum amount of memory (in bytes) that the underlying libjpeg
+   * instance may have allocated once its whole-image buffers (such as the
+   * coefficient buffer) are allocated.  (The buffers for very small images
+   * may be allocated even if they exceed this limit.)  This sets the libjpeg
+   * <tt>max_memory_to_use</tt> parameter, overriding the value from the
+   * <tt>JPEGMEM</tt> environment variable.  If this is 0, then the value from
+   * <tt>JPEGMEM</tt> (if any) is used.
+   */
+  unsigned long maxMemory;
+  /**
+   * The maximum number of scans in a progressive or other multi-scan JPEG
+   * image.  If #TJFLAG_LIMITSCANS is also specified, then the smaller of
+   * this limit and 500 applies.
+   */
+  int maxScans;
+} tjlimits;
+
 /**
  * TurboJPEG instance handle
  */
@@ -757,6 +855,68 @@ DLLEXPORT int tjCompress2(tjhandle handle, const unsigned char *srcBuf,
                           int jpegSubsamp, int jpegQual, int flags);
 
 
+/**
+ * Compress multiple rectangular regions of an RGB, grayscale, or CMYK image
+ * into separate JPEG images.  This is equivalent to calling #tjCompress2()
+ * once for each region, but the compression parameters are set up only once
+ * for the whole batch, which substantially reduces the per-image overhead when
+ * compressing many small regions (such as the changed regions of a remote
+ * framebuffer.)
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param srcBuf pointer to an image buffer containing RGB, grayscale, or
+ * CMYK pixels from which the regions will be compressed
+ *
+ * @param width width (in pixels) of the source image
+ *
+ * @param pitch bytes per line in the source image (see #tjCompress2().)
+ * Setting this parameter to 0 is the equivalent of setting it to
+ * <tt>width * #tjPixelSize[pixelFormat]</tt>.
+ *
+ * @param height height (in pixels) of the source image
+ *
+ * @param pixelFormat pixel format of the source image (see @ref TJPF
+ * "Pixel formats".)
+ *
+ * @param regions an array of #tjregion structures, each of which specifies a
+ * region of the source image to compress.  The coordinates are relative to the
+ * top-left corner of the source image, even if #TJFLAG_BOTTOMUP is specified.
+ * Each region must lie entirely within the source image, and its width and
+ * height must be greater than 0.
+ *
+ * @param numRegions the number of regions to compress
+ *
+ * @param jpegBufs an array of <tt>numRegions</tt> pointers to image buffers
+ * that will receive the JPEG images.  Each buffer is handled in the same
+ * manner as the <tt>jpegBuf</tt> parameter of #tjCompress2().
+ *
+ * @param jpegSizes an array of <tt>numRegions</tt> unsigned long variables
+ * that hold the sizes of the JPEG image buffers.  Each variable is handled in
+ * the same manner as the <tt>jpegSize</tt> parameter of #tjCompress2().
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the JPEG images (see @ref TJSAMP
+ * "Chrominance subsampling options".)
+ *
+ * @param jpegQual the image quality of the generated JPEG images (1 = worst,
+ * 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags".  #TJFLAG_INCREMENTAL is ignored.
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)  If an error occurs, then the regions preceding the
+ * one that caused the error will have been compressed.
+ */
+DLLEXPORT int tjCompressRegions(tjhandle handle, const unsigned char *srcBuf,
+                                int width, int pitch, int height,
+                                int pixelFormat, const tjregion *regions,
+                                int numRegions, unsigned char **jpegBufs,
+                                unsigned long *jpegSizes, int jpegSubsamp,
+                                int jpegQual, int flags);
+
+
 /**
  * Compress a YUV planar image into a JPEG image.
  *
@@ -1230,6 +1390,163 @@ DLLEXPORT int tjDecompress2(tjhandle handle, const unsigned char *jpegBuf,
                             int flags);
 
 
+/**
+ * Decompress the next frame of a Motion-JPEG stream to an RGB, grayscale, or
+ * CMYK image.  The stream consists of concatenated JPEG images, optionally
+ * separated by padding or other data, such as the frames of an MJPEG track
+ * extracted from an AVI or QuickTime file or received from a camera.  Any
+ * bytes preceding the next SOI marker are skipped.
+ *
+ * Decompressing successive frames with the same TurboJPEG instance avoids
+ * most of the per-frame setup cost:  the Huffman and quantization tables
+ * persist from frame to frame, and the derived Huffman decoding tables are
+ * reused as long as the Huffman tables don't change.  Frames that omit their
+ * Huffman or quantization tables are decompressed using the tables from the
+ * most recent frame that defined them, or using the standard Huffman tables
+ * if no frame has defined them (as is the convention for Motion-JPEG.)
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param mjpegBuf pointer to the remaining (not yet decompressed) portion of
+ * the Motion-JPEG stream
+ *
+ * @param mjpegSize size of the remaining portion of the Motion-JPEG stream
+ * (in bytes)
+ *
+ * @param frameSize pointer to an unsigned long variable that will receive the
+ * number of bytes of <tt>mjpegBuf</tt> that were consumed, including any data
+ * preceding the frame.  The next frame begins at
+ * <tt>mjpegBuf + *frameSize</tt>.  This is set even if an error occurred, so
+ * that the caller can skip a corrupt frame.  In that case, it always includes
+ * at least the frame's SOI marker, so a caller that skips frames in this
+ * manner always makes progress.  If no SOI marker is found, then it is set to
+ * <tt>mjpegSize</tt>.
+ *
+ * @param dstBuf pointer to an image buffer that will receive the decompressed
+ * frame (see #tjDecompress2() for the required size.)
+ *
+ * @param width desired width (in pixels) of the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param pitch bytes per line in the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param height desired height (in pixels) of the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressMJPEG(tjhandle handle,
+                                const unsigned char *mjpegBuf,
+                                unsigned long mjpegSize,
+                                unsigned long *frameSize,
+                                unsigned char *dstBuf, int width, int pitch,
+                                int height, int pixelFormat, int flags);
+
+
+/**
+ * Decompress a low-quality preview of a progressive JPEG image to an RGB,
+ * grayscale, or CMYK image, using only the first <tt>numScans</tt> scans or
+ * only the portion of the JPEG image that is available.  The preview has the
+ * same dimensions as the image that #tjDecompress2() would produce.  The scans
+ * are decoded using the libjpeg buffered-image mode, so interblock smoothing
+ * is applied to coefficients that are not yet known to full precision, and
+ * any data beyond the last scan used is not read.  This function can also be
+ * used with a single-scan JPEG image, in which case it is equivalent to
+ * #tjDecompress2().
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image (or the
+ * beginning of the JPEG image) to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes.)  This may be less than
+ * the size of the complete JPEG image, e.g. if the image is being received
+ * over a network, in which case the preview is generated from the data that
+ * has been received so far.  Note that, in that case, libjpeg will issue a
+ * warning regarding the premature end of the JPEG data, so this function will
+ * return -1, and #tjGetErrorCode() will return #TJERR_WARNING.  The preview
+ * image is still generated unless #TJFLAG_STOPONWARNING is specified.
+ *
+ * @param numScans the number of scans to use in generating the preview, or 0
+ * to use all of the scans in <tt>jpegBuf</tt>
+ *
+ * @param dstBuf pointer to an image buffer that will receive the decompressed
+ * image (see #tjDecompress2() for the required size.)
+ *
+ * @param width desired width (in pixels) of the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param pitch bytes per line in the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param height desired height (in pixels) of the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressPreview(tjhandle handle,
+                                  const unsigned char *jpegBuf,
+                                  unsigned long jpegSize, int numScans,
+                                  unsigned char *dstBuf, int width, int pitch,
+                                  int height, int pixelFormat, int flags);
+
+
+/**
+ * Compute a 1/8-scale grayscale image and/or a summary (average color and
+ * perceptual hash) of a JPEG image using only the DC coefficients of the
+ * image.  This function entropy-decodes the JPEG image without storing the AC
+ * coefficients, and it performs neither the inverse DCT nor upsampling nor
+ * color conversion.  (The DC
+ * coefficients of each individual component can be obtained as planar images
+ * by passing a 1/8 scaling factor to #tjDecompressToYUVPlanes().)  Only
+ * grayscale, YCbCr, and RGB JPEG images are supported.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to summarize
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param dstBuf pointer to an image buffer that will receive the grayscale
+ * (luminance) image, or NULL if the grayscale image is not needed.  The image
+ * has the dimensions of the JPEG image scaled by 1/8 (see #TJSCALED()), and
+ * each pixel is the average luminance of the corresponding 8x8 block in the
+ * JPEG image.  This buffer should normally be <tt>pitch * scaledHeight</tt>
+ * bytes in size.
+ *
+ * @param pitch bytes per line in the grayscale image.  Setting this parameter
+ * to 0 is the equivalent of setting it to the scaled width of the JPEG image.
+ *
+ * @param summary pointer to a #tjdcsummary structure that will receive the
+ * average color and perceptual hash of the JPEG image, or NULL if the summary
+ * is not needed
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressDC(tjhandle handle, const unsigned char *jpegBuf,
+                             unsigned long jpegSize, unsigned char *dstBuf,
+                             int pitch, tjdcsummary *summary, int flags);
+
+
 /**
  * Decompress a JPEG image to a YUV planar image.  This function performs JPEG
  * decompression but leaves out the color conversion step, so a planar YUV
@@ -1324,8 +1641,8 @@ DLLEXPORT int tjDecompressToYUV2(tjhandle handle, const unsigned char *jpegBuf,
  * possible image that will fit within the desired height.  If <tt>height</tt>
  * is set to 0, then only the width will be considered when determining the
  * scaled image size.  If the scaled height is not an even multiple of the MCU
- * block height (see #tjMCUHeight), then an intermediate buffer copy will be
- * performed within TurboJPEG.
+ * block height (see #tjMCUHeight), then the last row of MCU blocks will be
+ * decompressed into an intermediate buffer and copied within TurboJPEG.
  *
  * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
  * "flags"
@@ -1340,6 +1657,68 @@ DLLEXPORT int tjDecompressToYUVPlanes(tjhandle handle,
                                       int *strides, int height, int flags);
 
 
+/**
+ * Decompress a JPEG image into Y, U (Cb), and V (Cr) image planes one row of
+ * MCU blocks at a time, without copying the decompressed samples.  Each row of
+ * MCU blocks is decompressed into buffers owned by TurboJPEG, and a callback
+ * function is passed read-only pointers to those buffers.  This is useful for
+ * applications that only need to read each row once (for instance, in order to
+ * upload it to a GPU or feed it to a video encoder), since it avoids both the
+ * intermediate buffer copy that #tjDecompressToYUVPlanes() may perform and the
+ * need to allocate memory for the entire YUV image.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param width desired width (in pixels) of the YUV image (see
+ * #tjDecompressToYUVPlanes().)
+ *
+ * @param height desired height (in pixels) of the YUV image (see
+ * #tjDecompressToYUVPlanes().)
+ *
+ * @param rowHandler a callback function that is called once for each row of
+ * MCU blocks, from top to bottom
+ *
+ * @param data arbitrary data that will be passed to <tt>rowHandler</tt>
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * <tt>rowHandler</tt> receives the following arguments:
+ * - <tt>planes</tt>: an array of pointers to the first row of decompressed
+ * samples in the Y, U (Cb), and V (Cr) planes (or just the Y plane, if
+ * decompressing a grayscale image.)  These pointers, and the samples they
+ * point to, are valid only until <tt>rowHandler</tt> returns.
+ * - <tt>strides</tt>: an array of integers, each specifying the number of
+ * bytes between successive rows in the corresponding buffer
+ * - <tt>regions</tt>: an array of #tjregion structures, each specifying the
+ * position (<tt>y</tt>) of the rows within the corresponding scaled plane, as
+ * well as the number of valid samples per row (<tt>w</tt>) and the number of
+ * valid rows (<tt>h</tt>) in the buffer.  <tt>x</tt> is always 0.  Samples
+ * beyond the valid area are padding and should be ignored.
+ * - <tt>numPlanes</tt>: the number of planes (1 or 3)
+ * - <tt>data</tt>: the <tt>data</tt> pointer that was passed to this function
+ *
+ * <tt>rowHandler</tt> should return 0 if successful, or -1 if an error
+ * occurred, in which case decompression is aborted.
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjDecompressToYUVRows(tjhandle handle,
+                                    const unsigned char *jpegBuf,
+                                    unsigned long jpegSize, int width,
+                                    int height,
+                                    int (*rowHandler) (const unsigned char **,
+                                                       const int *,
+                                                       const tjregion *, int,
+                                                       void *),
+                                    void *data, int flags);
+
+
 /**
  * Decode a YUV planar image into an RGB or grayscale image.  This function
  * uses the accelerated color conversion routines in the underlying
@@ -1529,6 +1908,72 @@ DLLEXPORT int tjTransform(tjhandle handle, const unsigned char *jpegBuf,
                           tjtransform *transforms, int flags);
 
 
+/**
+ * Decompress a JPEG image, optionally scale it, and re-compress it into a new
+ * JPEG image with different subsampling and/or quality.  Unlike the sequence
+ * #tjDecompress2(), resize, #tjCompress2(), this function streams the image
+ * through the codec one iMCU row at a time, so no full-size intermediate
+ * buffer is ever allocated.  Furthermore, the image is passed between the
+ * decompressor and the compressor in its native (YCbCr, grayscale, YCCK,
+ * etc.) colorspace, so the RGB color conversion round trip is avoided.
+ * Scaling is performed by the scaled IDCT in the decompressor, so the
+ * destination image dimensions are limited to the scaling factors returned by
+ * #tjGetScalingFactors().
+ *
+ * @param handle a handle to a TurboJPEG transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG source image to
+ * transcode
+ *
+ * @param jpegSize size of the JPEG source image (in bytes)
+ *
+ * @param width desired width (in pixels) of the destination image.  If this
+ * is different than the width of the JPEG source image, then TurboJPEG will
+ * use scaling in the JPEG decompressor to generate the largest possible image
+ * that will fit within the desired width.  If <tt>width</tt> is set to 0,
+ * then only the height will be considered when determining the scaled image
+ * size.
+ *
+ * @param height desired height (in pixels) of the destination image.  If
+ * this is different than the height of the JPEG source image, then TurboJPEG
+ * will use scaling in the JPEG decompressor to generate the largest possible
+ * image that will fit within the desired height.  If <tt>height</tt> is set
+ * to 0, then only the width will be considered when determining the scaled
+ * image size.
+ *
+ * @param dstBuf address of a pointer to an image buffer that will receive the
+ * transcoded JPEG image.  The buffer is handled in the same manner as the
+ * <tt>jpegBuf</tt> argument of #tjCompress2(), except that the worst-case
+ * buffer size should be computed by calling #tjBufSize() with the scaled
+ * width and height.
+ *
+ * @param dstSize pointer to an unsigned long variable that holds the size of
+ * the JPEG image buffer.  If <tt>*dstBuf</tt> points to a pre-allocated
+ * buffer, then <tt>*dstSize</tt> should be set to the size of the buffer.
+ * Upon return, <tt>*dstSize</tt> will contain the size of the JPEG image (in
+ * bytes.)
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the destination image (see @ref TJSAMP
+ * "Chrominance subsampling options"), or -1 to use the same level of
+ * chrominance subsampling as the JPEG source image
+ *
+ * @param jpegQual the image quality of the destination image (1 = worst,
+ * 100 = best), or -1 to reuse the quantization tables from the JPEG source
+ * image
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_ACCURATEDCT
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2()
+ * and #tjGetErrorCode().)
+ */
+DLLEXPORT int tjTranscode(tjhandle handle, const unsigned char *jpegBuf,
+                          unsigned long jpegSize, int width, int height,
+                          unsigned char **dstBuf, unsigned long *dstSize,
+                          int jpegSubsamp, int jpegQual, int flags);
+
+
 /**
  * Destroy a TurboJPEG compressor, decompressor, or transformer instance.
  *
@@ -1681,6 +2126,73 @@ DLLEXPORT char *tjGetErrorStr2(tjhandle handle);
 DLLEXPORT int tjGetErrorCode(tjhandle handle);
 
 
+/**
+ * Set a time limit for the compression, decompression, and transform
+ * operations performed with a TurboJPEG instance.  If an operation takes
+ * longer than the specified amount of wall-clock time, then it is aborted, the
+ * function returns -1, and #tjGetErrorCode() returns #TJERR_ABORTED.  The time
+ * limit is checked between rows of MCU blocks and between progressive scans,
+ * so an operation may overrun the limit by the time required to process one
+ * MCU row.  The time limit does not apply to the YUV encoding and decoding
+ * functions (#tjEncodeYUVPlanes() and #tjDecodeYUVPlanes(), etc.)
+ *
+ * @param handle a handle to a TurboJPEG compressor, decompressor, or
+ * transformer instance
+ *
+ * @param msec the maximum number of milliseconds that each subsequent
+ * operation may take, or 0 to remove the time limit (the default)
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2().)
+ */
+DLLEXPORT int tjSetTimeout(tjhandle handle, int msec);
+
+
+/**
+ * Cancel the compression, decompression, or transform operation that is in
+ * progress with a TurboJPEG instance.  Unlike the other TurboJPEG functions,
+ * this function may be called from another thread while the instance is in
+ * use.  The operation is aborted at the next MCU row or progressive scan
+ * boundary, the function performing it returns -1, and #tjGetErrorCode()
+ * returns #TJERR_ABORTED.  Starting an operation discards any pending
+ * cancellation request, so if no operation is in progress, then this function
+ * has no effect.
+ *
+ * Cancellation is best-effort.  This function only sets a flag in the
+ * instance, which the operation polls, and the flag is written without any
+ * synchronization other than that provided by the platform's atomic writes of
+ * <tt>sig_atomic_t</tt>.  Thus, the operation may not observe the request
+ * immediately, and a request made just as an operation starts or completes may
+ * have no effect.
+ *
+ * @param handle a handle to a TurboJPEG compressor, decompressor, or
+ * transformer instance
+ *
+ * @return 0 if successful, or -1 if the handle is invalid
+ */
+DLLEXPORT int tjCancel(tjhandle handle);
+
+
+/**
+ * Set resource limits for the decompression and transform operations
+ * performed with a TurboJPEG instance.  The limits guard against JPEG images
+ * that would require an excessive amount of memory or CPU time to decompress.
+ * The pixel and coefficient memory limits are checked as soon as the JPEG
+ * header has been read, and the memory limit is checked before any
+ * whole-image buffers are allocated, so an image that exceeds any of these
+ * limits is rejected before most of the memory it would require is
+ * allocated.  An operation that exceeds a limit returns -1, and
+ * #tjGetErrorStr2() describes the limit that was exceeded.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param limits pointer to a #tjlimits structure specifying the limits, or
+ * NULL to remove all limits (the default)
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr2().)
+ */
+DLLEXPORT int tjSetLimits(tjhandle handle, const tjlimits *limits);
+
+
 /* Deprecated functions and macros */
 #define TJFLAG_FORCEMMX  8
 #define TJFLAG_FORCESSE  16